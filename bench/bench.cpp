@@ -0,0 +1,458 @@
+#include "lib/main.h"
+#include "lib/gui/simple_graphics.h"
+#include "lib/audio/audio_capture.h"
+#include "lib/audio/audio_visuals.h"
+#include "lib/audio/analysis_pipeline.h"
+#include "lib/settings.h"
+#include "lib/job_system.h"
+#include "lib/allocation_counter.h"
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <numeric>
+#include <random>
+
+
+// Benchmarks for every stage of the analysis and rendering path, run with `make bench`.
+//
+// Each benchmark runs an operation a fixed number of times after a short warm-up and records
+// the duration of every single run, so the results contain percentiles and not only the mean.
+// Heap allocations are counted with allocation_counter. The results are printed as
+// a table and written to a JSON (or CSV) file that can be compared between releases.
+
+
+volatile bool PROCESS_INTERRUPTED = false;
+
+
+// --- SYNTHETIC SIGNALS ---
+
+#define BENCH_SAMPLE_RATE    44100
+#define BENCH_SIGNAL_SECONDS 4
+#define BENCH_FRAME_TIME     (1000.0 / 60.0)  // Milliseconds per rendered frame
+
+enum class Signal { SineSweep, WhiteNoise, Silence, Impulses };
+
+static const std::vector<std::pair<Signal, const char*>> SIGNALS = {
+    {Signal::SineSweep,  "sine_sweep"},
+    {Signal::WhiteNoise, "white_noise"},
+    {Signal::Silence,    "silence"},
+    {Signal::Impulses,   "impulses"},
+};
+
+
+// Interleaved int16 frames, the same signal on every channel
+static std::vector<short> make_signal(Signal type, unsigned int channels, unsigned int sample_rate) {
+    const size_t frames = (size_t)sample_rate * BENCH_SIGNAL_SECONDS;
+    std::vector<short> samples(frames * channels, 0);
+
+    std::mt19937 generator(1234);
+    std::uniform_int_distribution<int> noise(-16000, 16000);
+
+    // Logarithmic sweep from 20 Hz to 20 kHz over the whole signal
+    const double start_freq = 20.0, stop_freq = 20000.0;
+    const double sweep_rate = std::log(stop_freq / start_freq) / BENCH_SIGNAL_SECONDS;
+    const size_t impulse_interval = sample_rate / 4;
+
+    for (size_t i = 0; i < frames; i++) {
+        double t = (double)i / sample_rate;
+        short sample = 0;
+
+        switch (type) {
+        case Signal::SineSweep:
+            sample = (short)(16000 * std::sin(2 * M_PI * start_freq * (std::exp(sweep_rate * t) - 1) / sweep_rate));
+            break;
+        case Signal::WhiteNoise:
+            sample = (short)noise(generator);
+            break;
+        case Signal::Silence:
+            break;
+        case Signal::Impulses:
+            sample = (i % impulse_interval == 0) ? 32767 : 0;
+            break;
+        }
+
+        for (unsigned int channel = 0; channel < channels; channel++) {
+            samples[i * channels + channel] = sample;
+        }
+    }
+
+    return samples;
+}
+
+
+// Hands out consecutive blocks of a signal and wraps around at the end
+class SignalCursor {
+
+public:
+    SignalCursor(const std::vector<short>& samples, unsigned int channels)
+        : samples(samples), channels(channels), frames(samples.size() / channels) {}
+
+    const short* next(size_t count) {
+        if (position + count > frames) position = 0;
+        const short* block = &samples[position * channels];
+        position += count;
+        return block;
+    }
+
+private:
+    const std::vector<short>& samples;
+    unsigned int channels;
+    size_t frames;
+    size_t position = 0;
+
+};
+
+
+
+// --- MEASUREMENT ---
+
+struct BenchmarkResult {
+    std::string name;
+    size_t iterations;
+    double mean_ns, min_ns, p50_ns, p90_ns, p99_ns, max_ns;
+    double allocations_per_op;
+};
+
+
+struct BenchmarkOptions {
+    std::string filter;
+    std::string output = "bench_results.json";
+    std::string renderer = "sdl";
+    double      scale  = 1.0;
+};
+
+
+static BenchmarkOptions options;
+static std::vector<BenchmarkResult> results;
+
+
+static double percentile(const std::vector<double>& sorted, double fraction) {
+    size_t index = (size_t)std::ceil(fraction * sorted.size());
+    return sorted[std::min(sorted.size() - 1, index > 0 ? index - 1 : 0)];
+}
+
+
+static void run_benchmark(const std::string& name, size_t iterations, const std::function<void()>& operation) {
+    if (!options.filter.empty() && name.find(options.filter) == std::string::npos) return;
+
+    iterations = std::max<size_t>(10, iterations * options.scale);
+    std::vector<double> durations(iterations);
+
+    // Warm up caches, lazily built tables and the branch predictor
+    for (size_t i = 0; i < iterations / 10; i++) operation();
+
+    uint64_t allocations_before = allocation_counter::count();
+
+    for (size_t i = 0; i < iterations; i++) {
+        auto start = std::chrono::steady_clock::now();
+        operation();
+        auto stop = std::chrono::steady_clock::now();
+        durations[i] = std::chrono::duration<double, std::nano>(stop - start).count();
+    }
+
+    uint64_t allocations = allocation_counter::count() - allocations_before;
+
+    BenchmarkResult result;
+    result.name       = name;
+    result.iterations = iterations;
+    result.mean_ns    = std::accumulate(durations.begin(), durations.end(), 0.0) / iterations;
+    result.allocations_per_op = (double)allocations / iterations;
+
+    std::sort(durations.begin(), durations.end());
+    result.min_ns = durations.front();
+    result.p50_ns = percentile(durations, 0.50);
+    result.p90_ns = percentile(durations, 0.90);
+    result.p99_ns = percentile(durations, 0.99);
+    result.max_ns = durations.back();
+
+    printf("%-48s %9.0f %9.0f %9.0f %9.0f %10.2f\n",
+        name.c_str(), result.mean_ns, result.p50_ns, result.p90_ns, result.p99_ns, result.allocations_per_op);
+
+    results.push_back(result);
+}
+
+
+static bool write_results(const std::string& path) {
+    std::ofstream file(path);
+    if (!file) {
+        std::cout << RED << "[BENCH ERROR]" << CLEAR << " Cannot write " << path << "." << std::endl;
+        return false;
+    }
+
+    bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+
+    if (csv) {
+        file << "name,iterations,mean_ns,min_ns,p50_ns,p90_ns,p99_ns,max_ns,allocations_per_op\n";
+        for (const BenchmarkResult& r : results) {
+            file << r.name << ',' << r.iterations << ',' << r.mean_ns << ',' << r.min_ns << ','
+                 << r.p50_ns << ',' << r.p90_ns << ',' << r.p99_ns << ',' << r.max_ns << ','
+                 << r.allocations_per_op << '\n';
+        }
+    } else {
+        file << "{\n  \"fft_precision\": \"" << (sizeof(fft_real) == sizeof(float) ? "single" : "double") << "\",\n";
+        file << "  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchmarkResult& r = results[i];
+            file << "    {\"name\": \"" << r.name << "\", \"iterations\": " << r.iterations
+                 << ", \"mean_ns\": " << r.mean_ns << ", \"min_ns\": " << r.min_ns
+                 << ", \"p50_ns\": " << r.p50_ns << ", \"p90_ns\": " << r.p90_ns
+                 << ", \"p99_ns\": " << r.p99_ns << ", \"max_ns\": " << r.max_ns
+                 << ", \"allocations_per_op\": " << r.allocations_per_op << "}"
+                 << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        file << "  ]\n}\n";
+    }
+
+    std::cout << GREEN << "[BENCH INFO]" << CLEAR << " Wrote " << results.size() << " results to " << path << "." << std::endl;
+    return true;
+}
+
+
+
+// --- BENCHMARKS ---
+
+// One hop through every specialized pipeline, the generic fallback and the multiresolution one
+static void bench_pipelines() {
+    struct Variant { unsigned int channels; int fft_size; int hop_size; int band_count; AnalysisMode mode; };
+    const Variant variants[] = {
+        {2, 2048, 512, 20, AnalysisMode::Linear},
+        {2, 4096, 1024, 64, AnalysisMode::Linear},
+        {8, 1024, 256, 32, AnalysisMode::Linear},
+        {1, 2048, 512, 20, AnalysisMode::Linear},  // Generic
+        {2, 2048, 512, 20, AnalysisMode::Multiresolution},
+        {2, 4096, 1024, 64, AnalysisMode::Multiresolution},
+    };
+
+    for (const Variant& variant : variants) {
+        AnalysisConfig config;
+        config.channels    = variant.channels;
+        config.sample_rate = BENCH_SAMPLE_RATE;
+        config.fft_size    = variant.fft_size;
+        config.hop_size    = variant.hop_size;
+        config.band_count  = variant.band_count;
+        config.mode        = variant.mode;
+
+        std::unique_ptr<AnalysisPipeline> pipeline = create_analysis_pipeline(config);
+        if (!pipeline->prepare()) continue;
+
+        std::vector<double> intensities(config.band_count);
+        std::string prefix = "analysis/process_hop/" + std::to_string(variant.channels) + "ch_"
+                           + std::to_string(variant.fft_size) + "_" + std::to_string(variant.band_count)
+                           + (variant.mode == AnalysisMode::Multiresolution ? "_multires/" : "/");
+
+        for (const auto& [type, signal_name] : SIGNALS) {
+            std::vector<short> samples = make_signal(type, variant.channels, BENCH_SAMPLE_RATE);
+            SignalCursor cursor(samples, variant.channels);
+
+            run_benchmark(prefix + signal_name, 4000, [&]() {
+                pipeline->process_hop(cursor.next(config.hop_size), intensities.data());
+            });
+        }
+    }
+}
+
+
+// The analysis thread's work per period: one hop arrives through the ring buffer per call and
+// its spectrum is published
+static void bench_analyze_hops() {
+    CaptureSource& source = *capture_sources[0];
+    const int hop_size = source.pipeline->get_config().hop_size;
+
+    for (const auto& [type, signal_name] : SIGNALS) {
+        std::vector<short> samples = make_signal(type, settings.channels, settings.sample_rate);
+        SignalCursor cursor(samples, settings.channels);
+
+        run_benchmark(std::string("analysis/analyze_hops/") + signal_name, 4000, [&]() {
+            source.ring.push(cursor.next(hop_size), hop_size);
+            analyze_pending_hops(source, 0);
+        });
+    }
+}
+
+
+// Spectra of each signal, so the visual stages see realistic bar heights
+static std::vector<std::vector<double>> make_spectra(const std::vector<short>& samples) {
+    std::vector<std::vector<double>> spectra;
+    AnalysisPipeline& pipeline = *capture_sources[0]->pipeline;
+    const int hop_size = pipeline.get_config().hop_size;
+    SignalCursor cursor(samples, settings.channels);
+
+    for (int i = 0; i < 64; i++) {
+        std::vector<double> intensities(pipeline.get_config().band_count);
+        pipeline.process_hop(cursor.next(hop_size), intensities.data());
+        spectra.push_back(intensities);
+    }
+
+    return spectra;
+}
+
+
+static void bench_visuals() {
+    for (const auto& [type, signal_name] : SIGNALS) {
+        std::vector<std::vector<double>> spectra = make_spectra(make_signal(type, settings.channels, settings.sample_rate));
+        size_t index = 0;
+        std::vector<int> heights;
+
+        run_benchmark(std::string("visuals/calculate_heights/") + signal_name, 100000, [&]() {
+            calculate_heights(spectra[index++ % spectra.size()], heights);
+        });
+
+        // All particles once, i.e. the cost per rendered frame
+        audio_visuals::set_band_intensities(spectra[spectra.size() / 2]);
+        run_benchmark(std::string("visuals/particles_update/") + signal_name, 4000, [&]() {
+            particles.update(BENCH_FRAME_TIME);
+        });
+    }
+}
+
+
+// Scaling of the particle update over the job system, with a dense scene so that every
+// thread gets several chunks
+static void bench_parallel() {
+    const size_t dense_particles = 200000;
+    const unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<int> thread_counts = {1};
+    for (int count = 2; count < (int)cores; count *= 2) thread_counts.push_back(count);
+    if (cores > 1) thread_counts.push_back(cores);
+
+    particles.resize(dense_particles);
+
+    for (int threads : thread_counts) {
+        job_system::init(threads);
+
+        run_benchmark("parallel/particles_update/" + std::to_string(threads) + "_threads", 500, [&]() {
+            particles.begin_frame(BENCH_FRAME_TIME);
+            job_system::parallel_for("particles", particles.size(), PARTICLE_CHUNK_SIZE, [](size_t begin, size_t end) {
+                particles.update(begin, end);
+            });
+        });
+
+        job_system::print_stats();
+    }
+
+    particles.resize(settings.particle_count);
+    job_system::init(settings.threads);
+}
+
+
+// Drawing alone, then the whole per-frame path of the main loop: one frame's worth of audio
+// arrives, gets analyzed, and the frame is drawn and presented
+static void bench_frames() {
+    // Submitting all particles as one batch
+    run_benchmark("graphics/particles_draw", 1000, [&]() {
+        particles.draw();
+        simple_graphics::flush_batch();
+    });
+
+    run_benchmark("graphics/draw_frame", 1000, [&]() {
+        audio_visuals::draw_frame(BENCH_FRAME_TIME);
+    });
+
+    CaptureSource& source = *capture_sources[0];
+    const size_t frames_per_render = settings.sample_rate / 60;
+
+    for (const auto& [type, signal_name] : SIGNALS) {
+        std::vector<short> samples = make_signal(type, settings.channels, settings.sample_rate);
+        SignalCursor cursor(samples, settings.channels);
+
+        run_benchmark(std::string("frame/full/") + signal_name, 1000, [&]() {
+            source.ring.push(cursor.next(frames_per_render), frames_per_render);
+            analyze_pending_hops(source, 0);
+            visualize_audio();
+            audio_visuals::draw_frame(BENCH_FRAME_TIME);
+            simple_graphics::update_display();
+        });
+    }
+}
+
+
+
+static void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+        "  --filter <text>     Only run benchmarks whose name contains <text>\n"
+        "  --output <file>     Result file, CSV if it ends in .csv, JSON otherwise (default bench_results.json)\n"
+        "  --scale <factor>    Multiply the iteration counts, e.g. 0.1 for a quick run\n"
+        "  --renderer <name>   sdl (default, falls back to software) or software\n" << std::endl;
+}
+
+
+static bool parse_options(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        std::string flag = argv[i];
+
+        if (flag == "--help" || i + 1 >= argc) {
+            print_usage(argv[0]);
+            return false;
+        }
+
+        std::string value = argv[++i];
+
+        if (flag == "--filter") {
+            options.filter = value;
+        } else if (flag == "--output") {
+            options.output = value;
+        } else if (flag == "--renderer") {
+            options.renderer = value;
+        } else if (flag == "--scale") {
+            options.scale = std::atof(value.c_str());
+            if (options.scale <= 0) {
+                std::cout << RED << "[BENCH ERROR]" << CLEAR << " Invalid scale '" << value << "'." << std::endl;
+                return false;
+            }
+        } else {
+            std::cout << RED << "[BENCH ERROR]" << CLEAR << " Unknown option '" << flag << "'." << std::endl;
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+int main(int argc, char* argv[]) {
+    if (!parse_options(argc, argv)) {
+        return 1;
+    }
+
+    // No real window is needed, SDL renders into memory with the dummy video driver
+    setenv("SDL_VIDEODRIVER", "dummy", 0);
+
+    if (!init_analysis() || !job_system::init(settings.threads) || !audio_visuals::init()) {
+        return 1;
+    }
+
+    bool graphics = simple_graphics::init(options.renderer.c_str()) &&
+                    simple_graphics::create_display("Audio Visualizer Benchmark", WIDTH, HEIGHT, SDL_WINDOW_HIDDEN);
+
+    // Machines without any video driver can still benchmark the drawing on the CPU
+    if (!graphics && options.renderer == "sdl") {
+        std::cout << YELLOW << "[BENCH WARN]" << CLEAR << " No SDL renderer available, using the software renderer." << std::endl;
+        simple_graphics::close_display();
+        graphics = simple_graphics::init("software") &&
+                   simple_graphics::create_display("Audio Visualizer Benchmark", WIDTH, HEIGHT, SDL_WINDOW_HIDDEN);
+    }
+
+    if (!graphics) {
+        std::cout << YELLOW << "[BENCH WARN]" << CLEAR << " No renderer available, skipping the drawing benchmarks." << std::endl;
+    }
+
+    printf("\n%-48s %9s %9s %9s %9s %10s\n", "benchmark", "mean ns", "p50 ns", "p90 ns", "p99 ns", "allocs/op");
+
+    bench_pipelines();
+    bench_analyze_hops();
+    bench_visuals();
+    bench_parallel();
+
+    if (graphics) {
+        bench_frames();
+        simple_graphics::close_display();
+    }
+
+    job_system::shutdown();
+
+    printf("\n");
+
+    return write_results(options.output) ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+// Follows the spectra a running visualizer publishes with --shm, as an example of the reader
+// library. By default the newest spectrum of every source is drawn as a line of text bars,
+// with --log every frame is printed as CSV instead.
+//
+//     ./audio_visualizer --shm /audio_visualizer
+//     ./spectrum_consumer /audio_visualizer
+//     ./spectrum_consumer /audio_visualizer --log > bands.csv
+
+#include "lib/audio/spectrum_reader.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <signal.h>
+#include <thread>
+#include <time.h>
+#include <vector>
+
+
+static volatile bool interrupted = false;
+
+static void handle_sigint(int signal) {
+    (void)signal;
+    interrupted = true;
+}
+
+
+static uint64_t monotonic_ns() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+
+// Prints every frame of every source in order. Frames the consumer fell too far behind for are
+// counted, not printed.
+static void log_frames(SpectrumReader& reader) {
+    std::vector<uint64_t> cursors(reader.source_count());
+    uint64_t lost = 0;
+
+    printf("source,frame,capture_time_ns");
+    for (uint32_t band = 0; band < reader.band_count(); band++) printf(",band_%u", band);
+    printf("\n");
+
+    while (!interrupted && !reader.closed()) {
+        bool idle = true;
+
+        for (uint32_t source = 0; source < reader.source_count(); source++) {
+            uint64_t frame = cursors[source];
+
+            while (const SpectrumShmFrame* spectrum = reader.next(source, frame, &lost)) {
+                // Formatting straight from the shared memory, the line is dropped if the frame
+                // was overwritten meanwhile
+                char line[4096];
+                int length = snprintf(line, sizeof(line), "%u,%llu,%llu", source, (unsigned long long)frame, (unsigned long long)spectrum->capture_time_ns);
+                for (uint32_t band = 0; band < reader.band_count() && length < (int)sizeof(line) - 32; band++) {
+                    length += snprintf(line + length, sizeof(line) - length, ",%.1f", spectrum->bands()[band]);
+                }
+
+                if (reader.valid(spectrum, frame)) {
+                    puts(line);
+                } else {
+                    lost++;
+                }
+
+                cursors[source] = frame;
+                idle = false;
+            }
+        }
+
+        if (idle) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+
+    fprintf(stderr, "%llu frames lost.\n", (unsigned long long)lost);
+}
+
+
+// Redraws the newest spectrum of every source about 30 times a second
+static void show_bars(SpectrumReader& reader) {
+    static const char* levels[] = {" ", "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+    const double maximum_intensity = 600000;
+
+    while (!interrupted && !reader.closed()) {
+        for (uint32_t source = 0; source < reader.source_count(); source++) {
+            printf("%-16s ", reader.device(source));
+
+            uint64_t frame;
+            const SpectrumShmFrame* spectrum = reader.latest(source, frame);
+
+            int bars[256];
+            uint32_t band_count = std::min<uint32_t>(reader.band_count(), 256);
+            for (uint32_t band = 0; spectrum && band < band_count; band++) {
+                bars[band] = std::min(8, std::max(0, (int)(spectrum->bands()[band] / maximum_intensity * 8)));
+            }
+
+            uint64_t age_ns = spectrum ? monotonic_ns() - spectrum->capture_time_ns : 0;
+
+            // Every source keeps its line, even without a usable spectrum
+            if (!spectrum || !reader.valid(spectrum, frame)) {
+                printf("\033[K\n");
+                continue;
+            }
+
+            for (uint32_t band = 0; band < band_count; band++) printf("%s", levels[bars[band]]);
+            printf(" %6.1f ms\n", age_ns / 1e6);
+        }
+
+        // Back to the first line of this block
+        printf("\033[%uA", reader.source_count());
+        fflush(stdout);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(33));
+    }
+
+    printf("\033[%uB\n", reader.source_count());
+}
+
+
+int main(int argc, char* argv[]) {
+    const char* name = argc > 1 && argv[1][0] == '/' ? argv[1] : "/audio_visualizer";
+    bool log = argc > 1 && strcmp(argv[argc - 1], "--log") == 0;
+
+    signal(SIGINT, handle_sigint);
+
+    SpectrumReader reader;
+    while (!reader.open(name)) {
+        if (interrupted) return 1;
+
+        fprintf(stderr, "Waiting for %s...\n", name);
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    fprintf(stderr, "%u source(s), %u bands, a spectrum every %u samples.\n", reader.source_count(), reader.band_count(), reader.hop_size());
+    for (uint32_t source = 0; source < reader.source_count(); source++) {
+        fprintf(stderr, "  %s at %u Hz\n", reader.device(source), reader.sample_rate(source));
+    }
+
+    if (log) {
+        log_frames(reader);
+    } else {
+        show_bars(reader);
+    }
+
+    if (reader.closed()) fprintf(stderr, "The visualizer exited.\n");
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "allocation_counter.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+
+static std::atomic<uint64_t> allocations{0};
+
+static bool     reporting         = false;
+static uint64_t frames            = 0;
+static uint64_t frame_start       = 0;
+static uint64_t steady_total      = 0;  // After the warm-up
+static uint64_t steady_frames     = 0;
+static uint64_t allocating_frames = 0;
+static uint64_t worst_frame       = 0;
+
+
+#ifdef COUNT_ALLOCATIONS
+
+// The array, nothrow and sized forms all end up in these
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    void* pointer = std::malloc(size ? size : 1);
+    if (pointer == nullptr) throw std::bad_alloc();
+    return pointer;
+}
+
+
+void* operator new(size_t size, std::align_val_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    // aligned_alloc() wants a multiple of the alignment
+    size_t align = std::max(sizeof(void*), (size_t)alignment);
+    void* pointer = std::aligned_alloc(align, (std::max<size_t>(size, 1) + align - 1) & ~(align - 1));
+    if (pointer == nullptr) throw std::bad_alloc();
+    return pointer;
+}
+
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+
+void operator delete(void* pointer, size_t size) noexcept {
+    (void)size;
+    std::free(pointer);
+}
+
+
+void operator delete(void* pointer, std::align_val_t alignment) noexcept {
+    (void)alignment;
+    std::free(pointer);
+}
+
+
+void operator delete(void* pointer, size_t size, std::align_val_t alignment) noexcept {
+    (void)size;
+    (void)alignment;
+    std::free(pointer);
+}
+
+#endif
+
+
+uint64_t allocation_counter::count() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+
+void allocation_counter::init(bool report) {
+#ifndef COUNT_ALLOCATIONS
+    if (report) {
+        std::cout << YELLOW << "[AL WARN]" << CLEAR << " Allocations aren't counted in this build, it needs CFLAGS += -DCOUNT_ALLOCATIONS." << std::endl;
+        report = false;
+    }
+#endif
+
+    reporting   = report;
+    frames      = 0;
+    frame_start = count();
+}
+
+
+void allocation_counter::end_frame() {
+    if (!reporting) return;
+
+    uint64_t frame_allocations = count() - frame_start;
+    frames++;
+
+    if (frames > ALLOCATION_WARMUP_FRAMES) {
+        steady_total += frame_allocations;
+        steady_frames++;
+        worst_frame = std::max(worst_frame, frame_allocations);
+
+        if (frame_allocations > 0 && allocating_frames++ < ALLOCATION_REPORT_LIMIT) {
+            std::cout << YELLOW << "[AL WARN]" << CLEAR << " Frame " << frames << " allocated " << frame_allocations << " times." << std::endl;
+        }
+    }
+
+    // Whatever the report itself allocated belongs to no frame
+    frame_start = count();
+}
+
+
+void allocation_counter::print_stats() {
+    if (!reporting || steady_frames == 0) return;
+
+    char line[192];
+    snprintf(line, sizeof(line), "%llu allocations in %llu frames after the warm-up (%.3f per frame, %llu frames allocated, at most %llu in one).",
+        (unsigned long long)steady_total, (unsigned long long)steady_frames, (double)steady_total / steady_frames,
+        (unsigned long long)allocating_frames, (unsigned long long)worst_frame);
+
+    std::cout << GREEN << "[AL INFO]" << CLEAR << " " << line << std::endl;
+}
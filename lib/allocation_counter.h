@@ -0,0 +1,35 @@
+#ifndef _ALLOCATION_COUNTER_H_
+#define _ALLOCATION_COUNTER_H_
+
+
+#include "main.h"
+
+
+// Frames after startup that may still allocate, while caches fill and buffers grow
+#define ALLOCATION_WARMUP_FRAMES 120
+
+// Frames that allocated are reported individually up to this many times
+#define ALLOCATION_REPORT_LIMIT 10
+
+
+// Counts heap allocations through a replaced global operator new. The replacement is only
+// compiled in with -DCOUNT_ALLOCATIONS (the benchmark always has it), otherwise allocations
+// cost nothing extra and count() stays 0. Reporting per frame is opt-in at runtime as well.
+//
+// After the warm-up the frame loop is expected to allocate nothing, so every frame that does is
+// reported. The count covers all threads, e.g. also the audio and analysis threads.
+namespace allocation_counter {
+
+    // Allocations since the process started
+    uint64_t count();
+
+    void init(bool report);
+
+    // Reports the allocations since the previous call if reporting is on
+    void end_frame();
+
+    void print_stats();
+}
+
+
+#endif
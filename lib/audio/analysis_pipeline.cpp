@@ -0,0 +1,54 @@
+#include "analysis_pipeline.h"
+#include "multires_pipeline.h"
+
+
+bool parse_analysis_mode(const std::string& name, AnalysisMode& mode) {
+    if      (name == "linear")   mode = AnalysisMode::Linear;
+    else if (name == "multires") mode = AnalysisMode::Multiresolution;
+    else return false;
+
+    return true;
+}
+
+
+bool AnalysisPipeline::prepare() {
+    frequency_bands = generate_frequency_bands(config.band_count, config.min_freq, config.max_freq);
+
+    if (!fft_engine.prepare(config.fft_size) || !stft.configure(config.fft_size, config.hop_size, config.window)) {
+        return false;
+    }
+
+    band_table.build(frequency_bands, fft_engine.size(), sample_rate.load(std::memory_order_relaxed));
+
+    return true;
+}
+
+
+std::unique_ptr<AnalysisPipeline> create_analysis_pipeline(const AnalysisConfig& config) {
+    std::unique_ptr<AnalysisPipeline> pipeline;
+
+    if (config.mode == AnalysisMode::Multiresolution) {
+        pipeline.reset(new MultiresolutionPipeline(config));
+    }
+
+    // Configurations that get a fully specialized pipeline: channels, frame size, band count
+    #define SPECIALIZATION(C, N, B)                                                    \
+        if (!pipeline && config.channels == C && config.fft_size == N && config.band_count == B) { \
+            pipeline.reset(new SpecializedPipeline<C, N, B>(config));                  \
+        }
+
+    SPECIALIZATION(2, 2048, 20)
+    SPECIALIZATION(2, 4096, 64)
+    SPECIALIZATION(8, 1024, 32)
+
+    #undef SPECIALIZATION
+
+    if (!pipeline) {
+        pipeline.reset(new SpecializedPipeline<0, 0, 0>(config));
+    }
+
+    std::cout << GREEN << "[AN INFO]" << CLEAR << " Using " << pipeline->name() << " analysis pipeline ("
+              << config.channels << " channels, " << config.fft_size << " samples, " << config.band_count << " bands)." << std::endl;
+
+    return pipeline;
+}
@@ -0,0 +1,161 @@
+#ifndef _ANALYSIS_PIPELINE_H_
+#define _ANALYSIS_PIPELINE_H_
+
+
+#include "../main.h"
+#include "../profiler.h"
+#include "ring_buffer.h"
+#include "fft_engine.h"
+#include "stft.h"
+#include "band_table.h"
+#include <atomic>
+#include <memory>
+
+
+// Linear is one FFT with evenly spaced bins. Multiresolution analyzes the lower bands at
+// decimated sample rates for finer bins there, see MultiresolutionPipeline.
+enum class AnalysisMode {
+    Linear,
+    Multiresolution
+};
+
+
+bool parse_analysis_mode(const std::string& name, AnalysisMode& mode);
+
+
+struct AnalysisConfig {
+    unsigned int channels    = 2;
+    unsigned int sample_rate = 44100;
+    int          fft_size    = 2048;
+    int          hop_size    = 512;
+    int          band_count  = 20;
+    WindowType   window      = WindowType::Hann;
+    AnalysisMode mode        = AnalysisMode::Linear;
+    float        min_freq    = 20.f;
+    float        max_freq    = 20000.f;
+};
+
+
+// The capture -> STFT -> FFT -> band part of the analysis. The state lives here, the processing
+// itself is implemented by SpecializedPipeline below.
+class AnalysisPipeline {
+
+public:
+    AnalysisPipeline(const AnalysisConfig& config) : config(config), sample_rate(config.sample_rate) {}
+    virtual ~AnalysisPipeline() = default;
+
+    // Plans the FFT and builds the lookup tables, call this before processing
+    virtual bool prepare();
+
+    // Consumes every complete hop waiting in the ring buffer. Returns true and writes
+    // get_config().band_count intensities if a new spectrum was computed.
+    virtual bool process(PCMRingBuffer& ring, double* band_intensities) = 0;
+
+    // Analyzes exactly one hop of interleaved frames from memory and always produces a
+    // spectrum. Used when the whole signal is available up front, e.g. for files.
+    virtual void process_hop(const short* frames, double* band_intensities) = 0;
+
+    virtual const char* name() const = 0;
+
+    // The device may not support the requested rate, the band table follows the actual one
+    void set_sample_rate(unsigned int rate) { sample_rate.store(rate, std::memory_order_relaxed); }
+
+    const AnalysisConfig& get_config() const { return config; }
+
+
+protected:
+    static constexpr fft_real PRE_EMPHASIS = 0.97;
+
+    AnalysisConfig config;
+    std::atomic<unsigned int> sample_rate;
+
+    FFTEngine fft_engine;
+    STFT      stft;
+    BandTable band_table;
+    std::vector<FrequencyBand> frequency_bands;
+
+    fft_real prev_sample = 0;  // Pre-emphasis state, carried over from the previous hop
+
+};
+
+
+// Channels, FrameSize and Bands are compile-time constants so the hot loops can be unrolled and
+// specialized. Zero means the value is taken from the runtime config instead, which is what the
+// generic fallback pipeline uses.
+template <int Channels, int FrameSize, int Bands>
+class SpecializedPipeline : public AnalysisPipeline {
+
+public:
+    using AnalysisPipeline::AnalysisPipeline;
+
+    bool process(PCMRingBuffer& ring, double* band_intensities) override {
+        // Feed every complete hop into the STFT history. The frames are downmixed straight out of
+        // the ring buffer without blocking the audio thread, and dropped if it overwrote them
+        // meanwhile. Only the newest frame is transformed since that is what ends up on screen.
+        bool new_frame = false;
+        PCMRingBuffer::View view;
+
+        while (ring.peek(view, config.hop_size)) {
+            fft_real state = prev_sample;
+            stft.stage<Channels>(view.first, view.first_frames, config.channels, PRE_EMPHASIS, state);
+            stft.stage<Channels>(view.second, view.second_frames, config.channels, PRE_EMPHASIS, state);
+
+            if (!ring.consume(view)) {
+                stft.discard_hop();
+                continue;
+            }
+
+            prev_sample = state;
+            stft.commit_hop();
+            new_frame = true;
+        }
+
+        // Nothing new arrived, so the spectrum has not changed either
+        if (!new_frame) {
+            return false;
+        }
+
+        transform(band_intensities);
+        return true;
+    }
+
+    void process_hop(const short* frames, double* band_intensities) override {
+        stft.stage<Channels>(frames, config.hop_size, config.channels, PRE_EMPHASIS, prev_sample);
+        stft.commit_hop();
+
+        transform(band_intensities);
+    }
+
+    const char* name() const override {
+        return (Channels > 0 && FrameSize > 0 && Bands > 0) ? "specialized" : "generic";
+    }
+
+
+private:
+    // Windows the newest frame, runs the FFT and maps the bins to bands
+    void transform(double* band_intensities) {
+        unsigned int rate = sample_rate.load(std::memory_order_relaxed);
+        if (!band_table.matches(fft_engine.size(), rate)) {
+            band_table.build(frequency_bands, fft_engine.size(), rate);
+        }
+
+        stft.windowed_frame<FrameSize>(fft_engine.input());
+
+        {
+            PROFILE_SCOPE(Fft);
+            fft_engine.execute();
+        }
+
+        PROFILE_SCOPE(BandMapping);
+        band_table.aggregate<Bands>(fft_engine.output(), band_intensities);
+    }
+
+};
+
+
+// Returns a multiresolution pipeline if the config asks for one, otherwise a specialized pipeline
+// if one was compiled for the configuration, otherwise the generic fallback
+std::unique_ptr<AnalysisPipeline> create_analysis_pipeline(const AnalysisConfig& config);
+
+
+#endif
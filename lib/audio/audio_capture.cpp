@@ -1,247 +1,687 @@
 #include "audio_capture.h"
+#include "../settings.h"
+#include "../profiler.h"
+#include "spectrum_publisher.h"
+#include <condition_variable>
 
 
-unsigned int CHANNELS = 2;
-unsigned int SAMPLE_RATE = 44100;
-unsigned int BUFFER_TIME_MS = 50;
-unsigned int FRAMES_PER_BUFFER = (SAMPLE_RATE * BUFFER_TIME_MS / 1000);
+std::vector<std::unique_ptr<CaptureSource>> capture_sources;
 
-std::vector<short> system_audio_data(FRAMES_PER_BUFFER * CHANNELS);
-std::mutex audio_mutex;
+// Sources that delivered a period and wait for a worker, in arrival order. A source is queued
+// at most once, so the ring never holds more than one entry per source.
+static std::mutex                  arrival_mutex;
+static std::condition_variable     arrival;
+static std::vector<CaptureSource*> ready_ring;
+static size_t                      ready_first = 0;
+static size_t                      ready_count = 0;
 
-std::vector<FrequencyBand> frequency_bands(BAR_COUNT, {0.f, 0.f});
+
+static uint64_t steady_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 
-std::vector<FrequencyBand> generate_frequency_bands(int num_bins, float start_freq, float end_freq) {
-    std::vector<FrequencyBand> frequency_bands(num_bins);
+bool make_analysis_config(AnalysisConfig& config) {
+    config.channels    = settings.channels;
+    config.sample_rate = settings.sample_rate;
+    config.fft_size    = settings.fft_size;
+    config.hop_size    = settings.hop_size;
+    config.band_count  = settings.band_count;
+
+    if (!parse_window_type(settings.window, config.window)) {
+        std::cout << RED << "[AN ERROR]" << CLEAR << " Unknown window '" << settings.window << "'." << std::endl;
+        return false;
+    }
 
-    // Logarithmic scale
-    for (int i = 0; i < num_bins; i++) {
-        float lower = start_freq * pow(end_freq / start_freq, static_cast<float>(i) / num_bins);
-        float upper = start_freq * pow(end_freq / start_freq, static_cast<float>(i + 1) / num_bins);
-        frequency_bands[i] = { lower, upper };
+    if (!parse_analysis_mode(settings.analysis, config.mode)) {
+        std::cout << RED << "[AN ERROR]" << CLEAR << " Unknown analysis mode '" << settings.analysis << "'." << std::endl;
+        return false;
     }
 
-    return frequency_bands;
+    return true;
 }
 
 
-void apply_pre_emphasis(std::vector<short>& audio_data, double alpha, std::vector<double>& pre_emphasized_data) {
-    pre_emphasized_data.resize(FRAMES_PER_BUFFER);
+bool init_analysis() {
+    // The analysis window is independent of the capture period. A new spectrum is available
+    // every hop, i.e. every ~11.6 ms with the defaults.
+    AnalysisConfig config;
+    if (!make_analysis_config(config)) {
+        return false;
+    }
+
+    BandFrame empty;
+    empty.bands.assign(config.band_count, 0.0);
+
+    capture_sources.clear();
+
+    for (size_t i = 0; i < settings.inputs.size(); i++) {
+        std::unique_ptr<CaptureSource> source = std::make_unique<CaptureSource>();
+
+        source->device      = settings.inputs[i];
+        source->index       = i;
+        source->playback    = i == 0;
+        source->channels    = settings.channels;
+        source->sample_rate = settings.sample_rate;
+        source->ring.reset(source->channels, source->sample_rate / 2);
+        source->band_frames.reset(empty);
+
+        // Plan the FFT and build the lookup tables up front so the first frames don't stall
+        source->pipeline = create_analysis_pipeline(config);
+        if (!source->pipeline->prepare()) {
+            return false;
+        }
+
+        capture_sources.push_back(std::move(source));
+    }
+
+    ready_ring.assign(capture_sources.size(), nullptr);
+    ready_first = 0;
+    ready_count = 0;
 
-    // Previous sample for pre-emphasis, initialized to zero
-    double prev_sample = 0.0;
+    return true;
+}
 
-    for (int i = 0; i < FRAMES_PER_BUFFER; i++) {
-        // Stereo to mono mix
-        double current_sample = (audio_data[i * 2] + audio_data[i * 2 + 1]) / 2.0;
 
-        // Apply pre-emphasis filter
-        pre_emphasized_data[i] = current_sample - alpha * prev_sample;
+bool analyze_pending_hops(CaptureSource& source, uint64_t capture_time_ns) {
+    PROFILE_SCOPE(Analysis);
 
-        // Store the current sample for the next iteration
-        prev_sample = current_sample;
+    BandFrame& frame = source.band_frames.write_slot();
+    if (!source.pipeline->process(source.ring, frame.bands.data())) {
+        return false;
     }
+
+    frame.sequence        = ++source.published_sequence;
+    frame.capture_time_ns = capture_time_ns;
+
+    // Other processes get every spectrum, the render thread only the newest one
+    spectrum_publisher::publish(source.index, capture_time_ns, frame.bands.data());
+    source.band_frames.publish();
+
+    return true;
 }
 
 
-std::vector<double> compute_fft() {
-    fftw_complex* in = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * FRAMES_PER_BUFFER);
-    fftw_complex* out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * FRAMES_PER_BUFFER);
-    fftw_plan plan = fftw_plan_dft_1d(FRAMES_PER_BUFFER, in, out, FFTW_FORWARD, FFTW_ESTIMATE);
+// Must be called with arrival_mutex held
+static void enqueue_source(CaptureSource& source) {
+    source.state = CaptureSource::State::Queued;
+    ready_ring[(ready_first + ready_count) % ready_ring.size()] = &source;
+    ready_count++;
+}
 
-    std::vector<double> pre_emphasized_data;
 
-    // Lock audio data and apply pre-emphasis safely
+// Called by a capture thread after every period. Only queues the source for a worker, which
+// holds the mutex just while it takes a source off the queue.
+static void signal_arrival(CaptureSource& source) {
     {
-        std::lock_guard<std::mutex> lock(audio_mutex);
-        apply_pre_emphasis(system_audio_data, 0.97, pre_emphasized_data);
+        std::lock_guard<std::mutex> lock(arrival_mutex);
+        source.arrival_time_ns = steady_now_ns();
 
-        // Copy pre-emphasized data to FFT input
-        for (int i = 0; i < FRAMES_PER_BUFFER; i++) {
-            in[i][0] = pre_emphasized_data[i];  // Real part
-            in[i][1] = 0.0;                     // Imaginary part set to 0
+        if (source.state == CaptureSource::State::Running) {
+            source.state = CaptureSource::State::RunningAgain;  // Queued again once the worker is done
         }
+
+        if (source.state != CaptureSource::State::Idle) {
+            return;
+        }
+
+        enqueue_source(source);
     }
+    arrival.notify_one();
+}
 
-    // Perform FFT
-    fftw_execute(plan);
 
-    std::vector<double> bin_intensities(BAR_COUNT, 0.0);
-    double freq_resolution = static_cast<double>(SAMPLE_RATE) / FRAMES_PER_BUFFER;
+int analysis_worker_count(int requested) {
+    if (requested > 0) return requested;
+
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    return std::max(1, std::min((int)capture_sources.size(), cores));
+}
+
 
-    // Calculate bin intensities (the logic remains the same)
-    for (int bin = 0; bin < BAR_COUNT; bin++) {
-        float lower_freq = frequency_bands[bin].lower_freq;
-        float upper_freq = frequency_bands[bin].upper_freq;
+void analysis_thread() {
+    std::cout << GREEN << "[AN INFO]" << CLEAR << " Analysis worker started." << std::endl;
 
-        int start_idx = static_cast<int>(lower_freq / freq_resolution);
-        int end_idx = std::min(static_cast<int>(upper_freq / freq_resolution), static_cast<int>(FRAMES_PER_BUFFER / 2));
+    uint64_t spectra = 0;
 
-        double bin_magnitude = 0.0;
-        
-        // Sum the magnitudes for the current frequency bin
-        for (int i = start_idx; i <= end_idx; i++) {
-            double real = out[i][0];
-            double imag = out[i][1];
-            double magnitude = sqrt(real * real + imag * imag);
-            bin_magnitude += magnitude;
+    while (!PROCESS_INTERRUPTED) {
+        CaptureSource* source;
+        uint64_t capture_time_ns;
+
+        {
+            std::unique_lock<std::mutex> lock(arrival_mutex);
+
+            // The timeout notices an interrupt even when no capture thread delivers anymore
+            arrival.wait_for(lock, std::chrono::milliseconds(100), [] { return ready_count > 0 || PROCESS_INTERRUPTED; });
+            if (ready_count == 0) continue;
+
+            source = ready_ring[ready_first];
+            ready_first = (ready_first + 1) % ready_ring.size();
+            ready_count--;
+
+            source->state   = CaptureSource::State::Running;
+            capture_time_ns = source->arrival_time_ns;
         }
 
-        // Normalize by the number of FFT samples in the bin
-        if (end_idx - start_idx > 0) {
-            bin_magnitude /= (end_idx - start_idx);
+        uint64_t start_ns = steady_now_ns();
+
+        if (analyze_pending_hops(*source, capture_time_ns)) {
+            // Only this worker touches the source until it is handed back below
+            SourceLatency& latency = source->latency;
+            double analysis_ms = (steady_now_ns() - start_ns) / 1e6;
+
+            latency.analyses++;
+            latency.total_queue_ms    += (start_ns - capture_time_ns) / 1e6;
+            latency.total_analysis_ms += analysis_ms;
+            latency.max_analysis_ms    = std::max(latency.max_analysis_ms, analysis_ms);
+            spectra++;
         }
 
-        // Custom scaling factor (boost higher frequencies more aggressively)
-        double custom_scale_factor = (1.0 + (double)bin / 10.0);
+        // A period that arrived meanwhile goes to the back of the queue, so a busy source
+        // can't keep a worker from the others
+        bool requeued = false;
+        {
+            std::lock_guard<std::mutex> lock(arrival_mutex);
+
+            if (source->state == CaptureSource::State::RunningAgain) {
+                enqueue_source(*source);
+                requeued = true;
+            } else {
+                source->state = CaptureSource::State::Idle;
+            }
+        }
 
-        // Apply the custom scale factor to the magnitude
-        bin_intensities[bin] = bin_magnitude * custom_scale_factor;
+        if (requeued) arrival.notify_one();
     }
 
-    fftw_destroy_plan(plan);
-    fftw_free(in);
-    fftw_free(out);
-
-    return bin_intensities;
+    std::cout << GREEN << "[AN INFO]" << CLEAR << " Analysis worker stopped after " << spectra << " spectra." << std::endl;
 }
 
 
-void audio_capture_and_playback_thread() {
-    // Audio source: hw:Loopback,1   (snd-aloop must be enabled!)
-    // Audio output: default
+const BandFrame* poll_band_frame(size_t source_index) {
+    CaptureSource& source = *capture_sources[source_index];
+    if (!source.band_frames.update()) return nullptr;
 
-    std::cout << GREEN << "[AC INFO]" << CLEAR << " Starting audio capture and playback thread..." << std::endl;
+    const BandFrame& frame = source.band_frames.read_slot();
+    SourceLatency& latency = source.latency;
 
+    // Spectra published between two frames are never drawn
+    if (latency.rendered_frames > 0) {
+        latency.skipped_frames += frame.sequence - latency.published_before - 1;
+    }
 
-    frequency_bands = generate_frequency_bands(BAR_COUNT, 20, 20000);
+    double latency_ms = (steady_now_ns() - frame.capture_time_ns) / 1e6;
 
+    latency.rendered_frames++;
+    latency.published_before  = frame.sequence;
+    latency.total_latency_ms += latency_ms;
+    latency.max_latency_ms    = std::max(latency.max_latency_ms, latency_ms);
 
-    // Setup audio capture and playback
+    return &frame;
+}
 
-    snd_pcm_t* capture_handle      = nullptr;
-    snd_pcm_t* playback_handle     = nullptr;
-    snd_pcm_hw_params_t* hw_params = nullptr;
-    short* local_buffer            = nullptr;
-    int dir, rc;
 
-    local_buffer = new short[FRAMES_PER_BUFFER * CHANNELS];
+void print_analysis_stats() {
+    for (const std::unique_ptr<CaptureSource>& source : capture_sources) {
+        const SourceLatency& latency = source->latency;
+        if (latency.rendered_frames == 0 || latency.analyses == 0) continue;
 
-    // Open capture PCM
-    rc = snd_pcm_open(&capture_handle, INPUT_DEVICE, SND_PCM_STREAM_CAPTURE, 0);
-    if (rc < 0) {
-        std::cout << RED << "[AC ERROR]" << CLEAR << " Unable to open PCM capture device." << std::endl;
-        PROCESS_INTERRUPTED = true;
-    }
+        std::cout << GREEN << "[AN INFO]" << CLEAR << " " << source->device << ": " << latency.rendered_frames << " spectra drawn, "
+                  << latency.skipped_frames << " replaced before being drawn." << std::endl;
 
-    // Open playback PCM
-    rc = snd_pcm_open(&playback_handle, OUTPUT_DEVICE, SND_PCM_STREAM_PLAYBACK, 0);
-    if (rc < 0) {
-        std::cout << RED << "[AC ERROR]" << CLEAR << " Unable to open PCM playback device." << std::endl;
-        PROCESS_INTERRUPTED = true;;
+        std::cout << GREEN << "[AN INFO]" << CLEAR << " " << source->device << ": " << latency.total_queue_ms / latency.analyses
+                  << " ms waiting for a worker, " << latency.total_analysis_ms / latency.analyses << " ms analysis (max "
+                  << latency.max_analysis_ms << " ms), " << latency.total_latency_ms / latency.rendered_frames
+                  << " ms from capture to the render thread (max " << latency.max_latency_ms << " ms) on average." << std::endl;
     }
+}
+
+
+// Sets up the hardware parameters for a capture or playback PCM. The sample rate and period size
+// are requests, the values the device actually picked are written back.
+static bool configure_pcm(CaptureSource& source, snd_pcm_t* handle, snd_pcm_access_t access, unsigned int& sample_rate, snd_pcm_uframes_t& period_size, const char* stream_name) {
+    snd_pcm_hw_params_t* hw_params = nullptr;
+    int dir, rc;
 
-    // Set up hardware parameters for capture
     snd_pcm_hw_params_malloc(&hw_params);
     if (!hw_params) {
         std::cout << RED << "[AC ERROR]" << CLEAR << " Failed to allocate hardware parameter structure." << std::endl;
-        PROCESS_INTERRUPTED = true;;
-    }
-
-    snd_pcm_hw_params_any(capture_handle, hw_params);
-    snd_pcm_hw_params_set_access(capture_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
-    snd_pcm_hw_params_set_format(capture_handle, hw_params, SND_PCM_FORMAT_S16_LE);
-    snd_pcm_hw_params_set_rate_near(capture_handle, hw_params, &SAMPLE_RATE, &dir);
-    snd_pcm_hw_params_set_channels(capture_handle, hw_params, CHANNELS);
-    snd_pcm_uframes_t buffer_size = FRAMES_PER_BUFFER;
-    snd_pcm_hw_params_set_period_size_near(capture_handle, hw_params, &buffer_size, &dir);
-    
-    rc = snd_pcm_hw_params(capture_handle, hw_params);
-    if (rc < 0) {
-        std::cout << RED << "[AC ERROR]" << CLEAR << " Unable to set HW parameters for capture." << std::endl;
-        PROCESS_INTERRUPTED = true;;
+        return false;
+    }
+
+    snd_pcm_hw_params_any(handle, hw_params);
+    snd_pcm_hw_params_set_access(handle, hw_params, access);
+    snd_pcm_hw_params_set_format(handle, hw_params, SND_PCM_FORMAT_S16_LE);
+    snd_pcm_hw_params_set_rate_near(handle, hw_params, &sample_rate, &dir);
+    snd_pcm_hw_params_set_channels(handle, hw_params, source.channels);
+    snd_pcm_hw_params_set_period_size_near(handle, hw_params, &period_size, &dir);
+    snd_pcm_uframes_t buffer_size = period_size * PERIODS_PER_BUFFER;
+    snd_pcm_hw_params_set_buffer_size_near(handle, hw_params, &buffer_size);
+
+    rc = snd_pcm_hw_params(handle, hw_params);
+    if (rc == 0) {
+        snd_pcm_hw_params_get_period_size(hw_params, &period_size, &dir);
     }
 
     snd_pcm_hw_params_free(hw_params);
-    hw_params = nullptr;
 
-    // Set up hardware parameters for playback
-    snd_pcm_hw_params_malloc(&hw_params);
-    if (!hw_params) {
-        std::cout << RED << "[AC ERROR]" << CLEAR << " Failed to allocate hardware parameter structure." << std::endl;
-        PROCESS_INTERRUPTED = true;;
-    }
-
-    snd_pcm_hw_params_any(playback_handle, hw_params);
-    snd_pcm_hw_params_set_access(playback_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
-    snd_pcm_hw_params_set_format(playback_handle, hw_params, SND_PCM_FORMAT_S16_LE);
-    snd_pcm_hw_params_set_rate_near(playback_handle, hw_params, &SAMPLE_RATE, &dir);
-    snd_pcm_hw_params_set_channels(playback_handle, hw_params, CHANNELS);
-    buffer_size = FRAMES_PER_BUFFER;
-    snd_pcm_hw_params_set_period_size_near(playback_handle, hw_params, &buffer_size, &dir);
-    
-    rc = snd_pcm_hw_params(playback_handle, hw_params);
     if (rc < 0) {
-        std::cout << RED << "[AC ERROR]" << CLEAR << " Unable to set HW parameters for playback." << std::endl;
-        PROCESS_INTERRUPTED = true;;
+        // Failing to get mmap access is expected on some devices, the caller falls back to RW
+        if (access == SND_PCM_ACCESS_RW_INTERLEAVED) {
+            std::cout << RED << "[AC ERROR]" << CLEAR << " " << source.device << ": Unable to set HW parameters for " << stream_name << "." << std::endl;
+        }
+        return false;
     }
 
-    snd_pcm_hw_params_free(hw_params);
-    hw_params = nullptr;
+    return true;
+}
+
+
+// Recovers a stream after an xrun (or a suspend) instead of giving up. Returns false if the
+// stream could not be restarted.
+static bool recover_xrun(CaptureSource& source, snd_pcm_t* handle, int error, bool capture) {
+    if (capture) {
+        source.metrics.capture_xruns++;
+    } else {
+        source.metrics.playback_xruns++;
+    }
+
+    int rc = snd_pcm_recover(handle, error, 1);
+    if (rc < 0) {
+        std::cout << RED << "[AC ERROR]" << CLEAR << " " << source.device << ": Unable to recover from " << (capture ? "capture overrun" : "playback underrun")
+                  << ": " << snd_strerror(rc) << std::endl;
+        PROCESS_INTERRUPTED = true;
+        return false;
+    }
+
+    // Recovering only prepares the stream. Capture has to be restarted manually, playback starts
+    // again with the next write.
+    if (capture && snd_pcm_state(handle) == SND_PCM_STATE_PREPARED) {
+        snd_pcm_start(handle);
+    }
+
+    return true;
+}
+
+
+static bool is_xrun(int error) {
+    return error == -EPIPE || error == -ESTRPIPE;
+}
+
+
+// Returns a pointer to the given frame in an interleaved mmap area
+static short* mmap_frames(const snd_pcm_channel_area_t* areas, snd_pcm_uframes_t offset) {
+    return (short*)((char*)areas[0].addr + areas[0].first / 8 + offset * areas[0].step / 8);
+}
+
+
+// Copies frames into the playback ring area, waiting for room if the device is behind
+static void write_playback_mmap(CaptureSource& source, snd_pcm_t* playback_handle, const short* frames_in, snd_pcm_uframes_t frames) {
+    while (frames > 0 && !PROCESS_INTERRUPTED) {
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(playback_handle);
+
+        if (is_xrun(avail)) {
+            if (!recover_xrun(source, playback_handle, avail, false)) return;
+            continue;
+
+        } else if (avail < 0) {
+            std::cout << RED << "[AC ERROR]" << CLEAR << " Cannot write to PCM playback device: " << snd_strerror(avail) << std::endl;
+            PROCESS_INTERRUPTED = true;
+            return;
+
+        } else if (avail == 0) {
+            snd_pcm_wait(playback_handle, std::max(1u, source.period_frames * 1000 / source.sample_rate));
+            continue;
+        }
+
+        const snd_pcm_channel_area_t* playback_areas;
+        snd_pcm_uframes_t playback_offset;
+        snd_pcm_uframes_t chunk = std::min<snd_pcm_uframes_t>(frames, avail);
+
+        int rc = snd_pcm_mmap_begin(playback_handle, &playback_areas, &playback_offset, &chunk);
+        if (is_xrun(rc)) {
+            if (!recover_xrun(source, playback_handle, rc, false)) return;
+            continue;
+
+        } else if (rc < 0) {
+            std::cout << RED << "[AC ERROR]" << CLEAR << " Cannot map PCM playback buffer: " << snd_strerror(rc) << std::endl;
+            PROCESS_INTERRUPTED = true;
+            return;
+        }
+
+        std::memcpy(mmap_frames(playback_areas, playback_offset), frames_in, chunk * source.channels * sizeof(short));
+
+        snd_pcm_sframes_t committed = snd_pcm_mmap_commit(playback_handle, playback_offset, chunk);
+        if (committed < 0 && is_xrun(committed)) {
+            if (!recover_xrun(source, playback_handle, committed, false)) return;
+        }
+
+        frames_in += chunk * source.channels;
+        frames -= chunk;
+    }
+
+    // Unlike snd_pcm_writei, committing mmap frames does not necessarily start the stream
+    if (snd_pcm_state(playback_handle) == SND_PCM_STATE_PREPARED) {
+        snd_pcm_start(playback_handle);
+    }
+}
+
+
+// Moves one period straight from the capture ring area to the playback ring area. The analysis
+// side gets the same frames through the source's ring, no intermediate buffer is involved.
+// Sources without playback pass a null playback_handle.
+static void passthrough_mmap(CaptureSource& source, snd_pcm_t* capture_handle, snd_pcm_t* playback_handle) {
+    int rc = snd_pcm_wait(capture_handle, 1000);
+    if (is_xrun(rc)) {
+        recover_xrun(source, capture_handle, rc, true);
+        return;
+    }
+
+    snd_pcm_sframes_t avail = snd_pcm_avail_update(capture_handle);
+
+    if (is_xrun(avail)) {
+        recover_xrun(source, capture_handle, avail, true);
+        return;
+
+    } else if (avail < 0) {
+        std::cout << RED << "[AC ERROR]" << CLEAR << " " << source.device << ": Cannot read from PCM capture device: " << snd_strerror(avail) << std::endl;
+        PROCESS_INTERRUPTED = true;  // Exit loop on serious error
+        return;
+
+    } else if (avail < (snd_pcm_sframes_t)source.period_frames) {
+        return;  // Wait for a full period
+    }
+
+    PROFILE_SCOPE(Capture);
+
+    snd_pcm_uframes_t remaining = source.period_frames;
+
+    // A period can wrap around the end of the capture buffer, in which case it is mapped in two parts
+    while (remaining > 0 && !PROCESS_INTERRUPTED) {
+        const snd_pcm_channel_area_t* capture_areas;
+        snd_pcm_uframes_t capture_offset;
+        snd_pcm_uframes_t frames = remaining;
+
+        rc = snd_pcm_mmap_begin(capture_handle, &capture_areas, &capture_offset, &frames);
+        if (is_xrun(rc)) {
+            recover_xrun(source, capture_handle, rc, true);
+            return;
+
+        } else if (rc < 0) {
+            std::cout << RED << "[AC ERROR]" << CLEAR << " " << source.device << ": Cannot map PCM capture buffer: " << snd_strerror(rc) << std::endl;
+            PROCESS_INTERRUPTED = true;
+            return;
+        }
+
+        const short* frames_in = mmap_frames(capture_areas, capture_offset);
+
+        source.ring.push(frames_in, frames);
+        signal_arrival(source);
+        if (playback_handle) write_playback_mmap(source, playback_handle, frames_in, frames);
+
+        snd_pcm_sframes_t committed = snd_pcm_mmap_commit(capture_handle, capture_offset, frames);
+        if (is_xrun(committed)) {
+            recover_xrun(source, capture_handle, committed, true);
+            return;
+
+        } else if (committed < 0 || (snd_pcm_uframes_t)committed != frames) {
+            std::cout << RED << "[AC ERROR]" << CLEAR << " " << source.device << ": Cannot release PCM capture buffer." << std::endl;
+            PROCESS_INTERRUPTED = true;
+            return;
+        }
+
+        remaining -= frames;
+    }
+}
+
+
+// Reads a period into local_buffer and writes it back out, unless playback_handle is null. Used
+// if the devices don't support mmap.
+static void passthrough_rw(CaptureSource& source, snd_pcm_t* capture_handle, snd_pcm_t* playback_handle, short* local_buffer) {
+    int rc = snd_pcm_readi(capture_handle, local_buffer, source.period_frames);
+
+    if (is_xrun(rc)) {
+        recover_xrun(source, capture_handle, rc, true);
+
+    } else if (rc < 0) {
+        std::cout << RED << "[AC ERROR]" << CLEAR << " " << source.device << ": Cannot read from PCM capture device: " << snd_strerror(rc) << std::endl;
+        PROCESS_INTERRUPTED = true;  // Exit loop on serious error
+
+    } else {
+        if (rc != (int)source.period_frames) {
+            std::cout << YELLOW << "[AC WARN]" << CLEAR << " " << source.device << ": Short read from PCM capture device: read " << rc << " frames!" << std::endl;
+        }
+
+        PROFILE_SCOPE(Capture);
+
+        int frames_read = rc;
+
+        // Hand the frames to the analysis side. This never blocks, so the playback below
+        // can't stall the render thread.
+        source.ring.push(local_buffer, frames_read);
+        signal_arrival(source);
+
+        if (!playback_handle) return;
+
+        // Playback logic with similar error handling
+        rc = snd_pcm_writei(playback_handle, local_buffer, frames_read);
+        if (is_xrun(rc)) {
+            // The period is lost, but the stream keeps going
+            recover_xrun(source, playback_handle, rc, false);
+
+        } else if (rc < 0) {
+            std::cout << RED << "[AC ERROR]" << CLEAR << " Cannot write to PCM playback device." << std::endl;
+            PROCESS_INTERRUPTED = true;  // Exit loop on serious error
+
+        } else if (rc != frames_read) {
+            std::cout << YELLOW << "[AC WARN]" << CLEAR << " Short write to PCM playback device: wrote " << rc << " frames!" << std::endl;
+        }
+    }
+}
+
+
+// (Re)configures the devices for the given period size and starts them. The playback handle
+// is null for sources that are only captured.
+static bool start_streams(CaptureSource& source, snd_pcm_t* capture_handle, snd_pcm_t* playback_handle, bool& use_mmap, snd_pcm_uframes_t period_size) {
+    // Stop the streams if they are already running with another period size
+    if (snd_pcm_state(capture_handle) != SND_PCM_STATE_OPEN) snd_pcm_drop(capture_handle);
+    if (playback_handle && snd_pcm_state(playback_handle) != SND_PCM_STATE_OPEN) snd_pcm_drop(playback_handle);
+
+    // Prefer mmap access on both devices so periods can be moved between the ring areas directly
+    snd_pcm_uframes_t capture_period  = period_size;
+    snd_pcm_uframes_t playback_period = period_size;
+
+    // Each stream negotiates its own rate, only the capture rate is what gets analyzed
+    unsigned int capture_rate  = source.sample_rate;
+    unsigned int playback_rate = source.sample_rate;
+
+    if (use_mmap) {
+        use_mmap = configure_pcm(source, capture_handle, SND_PCM_ACCESS_MMAP_INTERLEAVED, capture_rate, capture_period, "capture") &&
+                   (!playback_handle || configure_pcm(source, playback_handle, SND_PCM_ACCESS_MMAP_INTERLEAVED, playback_rate, playback_period, "playback"));
+
+        if (!use_mmap) {
+            std::cout << YELLOW << "[AC WARN]" << CLEAR << " " << source.device << ": Mmap access not supported, falling back to read/write passthrough." << std::endl;
+        }
+    }
+
+    if (!use_mmap) {
+        capture_period  = period_size;
+        playback_period = period_size;
+        capture_rate    = source.sample_rate;
+        playback_rate   = source.sample_rate;
+
+        if (!configure_pcm(source, capture_handle, SND_PCM_ACCESS_RW_INTERLEAVED, capture_rate, capture_period, "capture") ||
+            (playback_handle && !configure_pcm(source, playback_handle, SND_PCM_ACCESS_RW_INTERLEAVED, playback_rate, playback_period, "playback"))) {
+            return false;
+        }
+    }
+
+    // The frames are passed through unchanged, so a different playback rate changes the pitch
+    if (playback_handle && playback_rate != capture_rate) {
+        std::cout << YELLOW << "[AC WARN]" << CLEAR << " " << source.device << ": Playback runs at " << playback_rate
+                  << " Hz, capture at " << capture_rate << " Hz, the passthrough will be off pitch." << std::endl;
+    }
+
+    source.sample_rate = capture_rate;
+
+    source.period_frames = capture_period;
+    source.metrics.period_frames = capture_period;
 
     // Prepare PCM devices
-    rc = snd_pcm_prepare(capture_handle);
+    int rc = snd_pcm_prepare(capture_handle);
     if (rc < 0) {
-        std::cout << RED << "[AC ERROR]" << CLEAR << " Unable to prepare PCM capture device." << std::endl;
-        PROCESS_INTERRUPTED = true;;
+        std::cout << RED << "[AC ERROR]" << CLEAR << " " << source.device << ": Unable to prepare PCM capture device." << std::endl;
+        return false;
     }
 
-    rc = snd_pcm_prepare(playback_handle);
+    if (playback_handle) {
+        rc = snd_pcm_prepare(playback_handle);
+        if (rc < 0) {
+            std::cout << RED << "[AC ERROR]" << CLEAR << " Unable to prepare PCM playback device." << std::endl;
+            return false;
+        }
+    }
+
+    // Unlike snd_pcm_readi, mmap access does not start the capture automatically
+    if (use_mmap) {
+        rc = snd_pcm_start(capture_handle);
+        if (rc < 0) {
+            std::cout << RED << "[AC ERROR]" << CLEAR << " " << source.device << ": Unable to start PCM capture device." << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+// Per capture thread state of adapt_period_size()
+struct PeriodAdaptation {
+    uint64_t known_xruns  = 0;
+    uint64_t window_xruns = 0;  // Since window_start
+    std::chrono::steady_clock::time_point window_start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point last_change  = std::chrono::steady_clock::now();  // Of the period size, or the last xrun
+};
+
+
+// Decides on the period size: small periods for low latency, larger ones only while xruns keep
+// happening. Returns the new period size, or the current one if nothing needs to change.
+static snd_pcm_uframes_t adapt_period_size(const CaptureSource& source, PeriodAdaptation& adaptation) {
+    snd_pcm_uframes_t period_size = source.period_frames;
+
+    uint64_t xruns = source.metrics.capture_xruns + source.metrics.playback_xruns;
+    auto now = std::chrono::steady_clock::now();
+
+    if (xruns != adaptation.known_xruns) {
+        if (now - adaptation.window_start > std::chrono::seconds(XRUN_WINDOW_SECONDS)) {
+            adaptation.window_start = now;
+            adaptation.window_xruns = 0;
+        }
+
+        adaptation.window_xruns += xruns - adaptation.known_xruns;
+        adaptation.known_xruns   = xruns;
+        adaptation.last_change   = now;
+
+        if (adaptation.window_xruns >= XRUNS_BEFORE_GROWING && period_size < MAX_PERIOD_FRAMES) {
+            adaptation.window_start = now;
+            adaptation.window_xruns = 0;
+            return std::min<snd_pcm_uframes_t>(period_size * 2, MAX_PERIOD_FRAMES);
+        }
+
+    } else if (now - adaptation.last_change > std::chrono::seconds(STABLE_SECONDS_BEFORE_SHRINK) && period_size > MIN_PERIOD_FRAMES) {
+        adaptation.last_change = now;
+        return std::max<snd_pcm_uframes_t>(period_size / 2, MIN_PERIOD_FRAMES);
+    }
+
+    return period_size;
+}
+
+
+void capture_thread(size_t source_index) {
+    // Audio sources: settings.inputs, e.g. hw:Loopback,1   (snd-aloop must be enabled!)
+    // Audio output:  OUTPUT_DEVICE, only for the first source
+
+    CaptureSource& source = *capture_sources[source_index];
+
+    std::cout << GREEN << "[AC INFO]" << CLEAR << " Starting audio capture" << (source.playback ? " and playback" : "")
+              << " thread for " << source.device << "..." << std::endl;
+
+
+    // Setup audio capture and playback
+
+    snd_pcm_t* capture_handle  = nullptr;
+    snd_pcm_t* playback_handle = nullptr;
+    bool use_mmap              = true;
+    bool failed                = false;
+    int rc;
+
+    std::vector<short> local_buffer;
+    PeriodAdaptation adaptation;
+
+    // Open capture PCM
+    rc = snd_pcm_open(&capture_handle, source.device.c_str(), SND_PCM_STREAM_CAPTURE, 0);
     if (rc < 0) {
-        std::cout << RED << "[AC ERROR]" << CLEAR << " Unable to prepare PCM playback device." << std::endl;
-        PROCESS_INTERRUPTED = true;;
+        std::cout << RED << "[AC ERROR]" << CLEAR << " Unable to open PCM capture device " << source.device << "." << std::endl;
+        failed = true;
     }
 
-    std::cout << GREEN << "[AC INFO]" << CLEAR << " Audio capture and playback setup copmlete." << std::endl;
+    // Open playback PCM
+    if (source.playback) {
+        rc = snd_pcm_open(&playback_handle, OUTPUT_DEVICE, SND_PCM_STREAM_PLAYBACK, 0);
+        if (rc < 0) {
+            std::cout << RED << "[AC ERROR]" << CLEAR << " Unable to open PCM playback device." << std::endl;
+            failed = true;
+        }
+    }
 
-    std::cout << GREEN << "[AC INFO]" << CLEAR << " Audio recording and playback started." << std::endl;
+    if (!failed && !start_streams(source, capture_handle, playback_handle, use_mmap, START_PERIOD_FRAMES)) {
+        failed = true;
+    }
+
+    if (failed) {
+        if (capture_handle) snd_pcm_close(capture_handle);
+        if (playback_handle) snd_pcm_close(playback_handle);
+
+        PROCESS_INTERRUPTED = true;
+        return;
+    }
+
+    // The device might not support the requested sample rate
+    source.pipeline->set_sample_rate(source.sample_rate);
+    spectrum_publisher::set_sample_rate(source.index, source.sample_rate);
+
+    std::cout << GREEN << "[AC INFO]" << CLEAR << " " << source.device << ": Audio recording" << (source.playback ? " and playback" : "")
+              << " started (" << (use_mmap ? "mmap" : "read/write") << ", " << source.period_frames << " frame periods)." << std::endl;
 
 
     // Finally capture and output audio
 
+    uint64_t reported_overruns = source.ring.overruns();
+
     while (!PROCESS_INTERRUPTED) {
-        int rc = snd_pcm_readi(capture_handle, local_buffer, FRAMES_PER_BUFFER);
+        if (use_mmap) {
+            passthrough_mmap(source, capture_handle, playback_handle);
+        } else {
+            local_buffer.resize(source.period_frames * source.channels);
+            passthrough_rw(source, capture_handle, playback_handle, local_buffer.data());
+        }
 
-        if (rc == -EPIPE) {
-            std::cout << RED << "[AC ERROR]" << CLEAR << " Overrun occurred in capture." << std::endl;
-            snd_pcm_prepare(capture_handle);
-            PROCESS_INTERRUPTED = true;;
+        // Report backpressure whenever the analysis side has fallen behind
+        if (source.ring.overruns() != reported_overruns) {
+            reported_overruns = source.ring.overruns();
+            std::cout << YELLOW << "[AC WARN]" << CLEAR << " " << source.device << ": Ring buffer overruns: " << reported_overruns
+                      << ", dropped frames: " << source.ring.dropped_frames() << std::endl;
+        }
 
-        } else if (rc < 0) {
-            std::cout << RED << "[AC ERROR]" << CLEAR << " Cannot read from PCM capture device: " << snd_strerror(rc) << std::endl;
-            PROCESS_INTERRUPTED = true;;  // Exit loop on serious error
+        snd_pcm_uframes_t new_period_size = adapt_period_size(source, adaptation);
 
-        } else if (rc != (int)FRAMES_PER_BUFFER) {
-            std::cout << YELLOW << "[AC WARN]" << CLEAR << " Short read from PCM capture device: read " << rc << " frames!" << std::endl;
+        if (new_period_size != source.period_frames && !PROCESS_INTERRUPTED) {
+            std::cout << YELLOW << "[AC WARN]" << CLEAR << " " << source.device << ": Changing period size from " << source.period_frames
+                      << " to " << new_period_size << " frames (xruns: " << source.metrics.capture_xruns << " capture, "
+                      << source.metrics.playback_xruns << " playback)." << std::endl;
 
-        } else {
-            std::lock_guard<std::mutex> lock(audio_mutex);
-            std::copy(local_buffer, local_buffer + FRAMES_PER_BUFFER * CHANNELS, system_audio_data.begin());
-
-            // Playback logic with similar error handling
-            rc = snd_pcm_writei(playback_handle, local_buffer, FRAMES_PER_BUFFER);
-            if (rc == -EPIPE) {
-                std::cout << RED << "[AC ERROR]" << CLEAR << " Underrun occurred in playback." << std::endl;
-                snd_pcm_prepare(playback_handle);
-                PROCESS_INTERRUPTED = true;;
-
-            } else if (rc < 0) {
-                std::cout << RED << "[AC ERROR]" << CLEAR << " Cannot write to PCM playback device." << std::endl;
-                PROCESS_INTERRUPTED = true;;  // Exit loop on serious error
-
-            } else if (rc != (int)FRAMES_PER_BUFFER) {
-                std::cout << YELLOW << "[AC WARN]" << CLEAR << " Short write to PCM playback device: wrote " << rc << " frames!" << std::endl;
+            if (!start_streams(source, capture_handle, playback_handle, use_mmap, new_period_size)) {
+                PROCESS_INTERRUPTED = true;
             }
         }
     }
@@ -249,7 +689,12 @@ void audio_capture_and_playback_thread() {
     // Cleanup on exit
     if (capture_handle) snd_pcm_close(capture_handle);
     if (playback_handle) snd_pcm_close(playback_handle);
-    if (local_buffer) delete[] local_buffer;
 
-    std::cout << YELLOW << "[AC WARN]" << CLEAR << " Audio capture and playback thread stopped!" << std::endl;
+    std::cout << GREEN << "[AC INFO]" << CLEAR << " " << source.device << ": Ring buffer overruns: " << source.ring.overruns()
+              << ", dropped frames: " << source.ring.dropped_frames() << std::endl;
+
+    std::cout << GREEN << "[AC INFO]" << CLEAR << " " << source.device << ": Xruns: " << source.metrics.capture_xruns << " capture, "
+              << source.metrics.playback_xruns << " playback. Final period size: " << source.metrics.period_frames << " frames." << std::endl;
+
+    std::cout << YELLOW << "[AC WARN]" << CLEAR << " Audio capture thread for " << source.device << " stopped!" << std::endl;
 }
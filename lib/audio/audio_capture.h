@@ -3,23 +3,110 @@
 
 
 #include "../main.h"
+#include "ring_buffer.h"
+#include "analysis_pipeline.h"
+#include "triple_buffer.h"
 
 
-#define BAR_COUNT 20
+// The capture starts with short periods for low latency. The periods only grow when several
+// xruns happen within a short window, so a single hiccup doesn't cost latency for good, and
+// shrink again once the stream has been free of xruns for a while.
+#define START_PERIOD_FRAMES          256
+#define MIN_PERIOD_FRAMES            128
+#define MAX_PERIOD_FRAMES            4096
+#define PERIODS_PER_BUFFER           4
+#define XRUNS_BEFORE_GROWING         3
+#define XRUN_WINDOW_SECONDS          10
+#define STABLE_SECONDS_BEFORE_SHRINK 30
 
 
-struct FrequencyBand {
-    float lower_freq;
-    float upper_freq;
+// One spectrum as published by the analysis thread
+struct BandFrame {
+    uint64_t            sequence        = 0;  // Counts the published spectra, starting at 1
+    uint64_t            capture_time_ns = 0;  // Steady clock time the newest analyzed period arrived
+    std::vector<double> bands;
 };
 
 
-std::vector<FrequencyBand> generate_frequency_bands(int num_bins, float start_freq, float end_freq);
-std::vector<double> compute_fft();
-void audio_capture_and_playback_thread();
+struct CaptureMetrics {
+    std::atomic<uint64_t>     capture_xruns{0};
+    std::atomic<uint64_t>     playback_xruns{0};
+    std::atomic<unsigned int> period_frames{0};
+};
+
+
+// Where the time between a period arriving and its spectrum being drawn goes, per source
+struct SourceLatency {
+    // Analysis side, written by whichever worker analyzed the source
+    uint64_t analyses          = 0;  // Runs that published a spectrum
+    double   total_queue_ms    = 0;  // Period arrived until a worker picked the source up
+    double   total_analysis_ms = 0;  // Analyzing the pending hops
+    double   max_analysis_ms   = 0;
+
+    // Render side
+    uint64_t rendered_frames  = 0;
+    uint64_t skipped_frames   = 0;   // Spectra replaced before being drawn
+    uint64_t published_before = 0;
+    double   total_latency_ms = 0;   // Period arrived until the render thread picked it up
+    double   max_latency_ms   = 0;
+};
+
+
+// One capture device and everything its analysis needs. Every source has its own capture
+// thread, ring buffer and pipeline, only the first one is also played back on OUTPUT_DEVICE.
+struct CaptureSource {
+    std::string  device;
+    uint32_t     index         = 0;  // In capture_sources
+    bool         playback      = false;
+    unsigned int channels      = 2;
+    unsigned int sample_rate   = 44100;
+    unsigned int period_frames = START_PERIOD_FRAMES;  // Current period size, adapted at runtime
+
+    // Written by the capture thread, read by the analysis side without locking
+    PCMRingBuffer  ring{2, 22050};
+    CaptureMetrics metrics;
+
+    std::unique_ptr<AnalysisPipeline> pipeline;
+
+    // Written by the analysis side, read by the render thread
+    TripleBuffer<BandFrame> band_frames;
+    uint64_t published_sequence = 0;
+
+    SourceLatency latency;
+
+    // Scheduling state, guarded by the arrival mutex in audio_capture.cpp
+    enum class State : uint8_t { Idle, Queued, Running, RunningAgain };
+    State    state           = State::Idle;
+    uint64_t arrival_time_ns = 0;  // Steady clock time the newest period arrived
+};
+
+
+bool make_analysis_config(AnalysisConfig& config);
+
+// Creates one source per entry of settings.inputs and prepares their pipelines
+bool init_analysis();
+
+// Captures the source until PROCESS_INTERRUPTED is set. The first source also plays its audio back.
+void capture_thread(size_t source_index);
+
+// Analysis workers, shared by every source. A worker picks up whichever source delivered a
+// period, and a source is only ever analyzed by one worker at a time, so the render thread
+// never waits for an FFT and no spectrum is computed twice. 0 starts one worker per source,
+// limited to the number of cores.
+int  analysis_worker_count(int requested);
+void analysis_thread();
+
+// Analyzes every complete hop waiting in the source's ring and publishes the newest spectrum.
+// Returns false if there was no complete hop. The analysis workers call this, the benchmark
+// calls it directly.
+bool analyze_pending_hops(CaptureSource& source, uint64_t capture_time_ns);
+
+// Render side. The newest spectrum of the source if one was published since the last call,
+// otherwise nullptr.
+const BandFrame* poll_band_frame(size_t source_index);
+void print_analysis_stats();
 
-extern std::vector<FrequencyBand> frequency_bands;
-extern std::vector<short> system_audio_data;
+extern std::vector<std::unique_ptr<CaptureSource>> capture_sources;
 
 
 #endif
\ No newline at end of file
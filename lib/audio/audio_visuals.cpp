@@ -1,53 +1,483 @@
 #include "audio_visuals.h"
 #include "audio_visuals.h"
 #include "audio_capture.h"
+#include "../settings.h"
+#include "../job_system.h"
+#include "../profiler.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 
 std::vector<FreqIntensityBar> frequency_intensity_bars = {};
-std::vector<Particle> particles = {};
+std::vector<SpectrumPanel> spectrum_panels;
+size_t bars_per_panel = 0;
+ParticleSystem particles;
 uint maximum_intensity = 600000;
 
-float width_of_area_for_bar = VISUALIZER_WIDTH / BAR_COUNT;
-float bar_width             = width_of_area_for_bar * (2.f / 5.f);
-float padding               = width_of_area_for_bar - bar_width;
+// Layer with everything that doesn't move, see draw_static_layer()
+static int  static_layer = -1;
+static uint static_layer_intensity = 0;
+
+
+// Splits the display into a grid of tiles as close to square as possible, one per panel, and
+// centers a panel in every tile
+static void layout_panels(const std::vector<std::string>& labels) {
+    int count   = std::max<int>(1, labels.size());
+    int columns = (int)std::ceil(std::sqrt((double)count));
+    int rows    = (count + columns - 1) / columns;
+
+    int tile_width  = WIDTH / columns;
+    int tile_height = HEIGHT / rows;
 
+    float scale = std::min({1.f, (float)(tile_width - PANEL_MARGIN_X) / VISUALIZER_WIDTH, (float)(tile_height - PANEL_MARGIN_Y) / VISUALIZER_HEIGHT});
+    Size2d size = {std::max(1, (int)(VISUALIZER_WIDTH * scale)), std::max(1, (int)(VISUALIZER_HEIGHT * scale))};
 
-bool audio_visuals::init() {
-    for (int i = 0; i < BAR_COUNT; i++) {
-        uint x = padding/2 + ((WIDTH / 2 - VISUALIZER_WIDTH / 2) + i * width_of_area_for_bar);
-        RGBColor color = {255 - (255 / BAR_COUNT) * i, (255 / BAR_COUNT) * i, 0};
-        frequency_intensity_bars.push_back(FreqIntensityBar(x, HEIGHT/2, bar_width, 0, color));
+    spectrum_panels.clear();
+
+    for (int i = 0; i < count; i++) {
+        int center_x = (i % columns) * tile_width  + tile_width  / 2;
+        int center_y = (i / columns) * tile_height + tile_height / 2;
+
+        SpectrumPanel panel;
+        panel.label    = count > 1 ? labels[i] : "";
+        panel.position = Position2d{center_x - size.width / 2, center_y - size.height / 2};
+        panel.size     = size;
+        spectrum_panels.push_back(panel);
     }
+}
+
 
-    for (int i = 0; i < 1000; i++) {
-        Particle particle;
-        particles.push_back(particle);
+bool audio_visuals::init(const std::vector<std::string>& panel_labels) {
+    int bar_count = settings.band_count;
+
+    layout_panels(panel_labels);
+    bars_per_panel = bar_count;
+    frequency_intensity_bars.clear();
+
+    for (const SpectrumPanel& panel : spectrum_panels) {
+        float width_of_area_for_bar = (float)panel.size.width / bar_count;
+        float bar_width             = width_of_area_for_bar * (2.f / 5.f);
+        float padding               = width_of_area_for_bar - bar_width;
+
+        for (int i = 0; i < bar_count; i++) {
+            uint x = padding/2 + (panel.position.x + i * width_of_area_for_bar);
+            uint8_t green = 255 * i / bar_count;
+            RGBColor color = {(uint8_t)(255 - green), green, 0};
+            frequency_intensity_bars.push_back(FreqIntensityBar(x, panel.position.y + panel.size.height/2, std::max(1, (int)bar_width), 0, color));
+            frequency_intensity_bars.back().max_height = panel.size.height;
+        }
+    }
+
+    particles.resize(settings.particle_count);
+
+    if (static_layer < 0) {
+        static_layer = simple_graphics::create_layer();
     }
 
     return true;
 }
 
 
-std::vector<int> calculate_heights(std::vector<double> bin_intensities) {
+// Counter-based random numbers: the value only depends on the particle, how often it has
+// respawned and which coordinate is drawn. Unlike a generator with state, the spawns are the
+// same in every run and don't depend on which thread updates which chunk.
+static inline uint32_t particle_random(size_t index, uint32_t spawn, uint32_t coordinate) {
+    // SplitMix64 finalizer
+    uint64_t value = ((uint64_t)index << 32 | spawn) * 0x9E3779B97F4A7C15ull + coordinate;
+
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+    return (uint32_t)((value ^ (value >> 31)) >> 32);
+}
+
+
+ParticleSystem::ParticleSystem() {
+    for (int i = 0; i <= 256; i++) {
+        speed_curve[i] = 1.f / (25000.f - std::pow((float)i, 1.8f));
+    }
+}
+
+
+void ParticleSystem::resize(size_t count) {
+    size_t old_count = size();
+
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+    previous_x.resize(count);
+    previous_y.resize(count);
+    previous_z.resize(count);
+    brightness.resize(count, 100.f);
+    spawns.resize(count, 0);
+
+    // New particles start anywhere on the screen
+    for (size_t i = old_count; i < count; i++) {
+        x[i] = previous_x[i] = particle_random(i, 0, 0) % WIDTH;
+        y[i] = previous_y[i] = particle_random(i, 0, 1) % HEIGHT;
+        z[i] = previous_z[i] = 3 + particle_random(i, 0, 2) % 3;
+    }
+}
+
+
+void ParticleSystem::reposition(size_t index) {
+    uint32_t spawn = ++spawns[index];
+
+    // The particles are spread evenly over the panels and respawn inside their own one
+    Position2d position = {WIDTH/2 - VISUALIZER_WIDTH/2, HEIGHT/2 - VISUALIZER_HEIGHT/2};
+    Size2d     area     = {VISUALIZER_WIDTH, VISUALIZER_HEIGHT};
+
+    if (!spectrum_panels.empty()) {
+        const SpectrumPanel& panel = spectrum_panels[index % spectrum_panels.size()];
+        position = panel.position;
+        area     = panel.size;
+    }
+
+    x[index] = position.x + particle_random(index, spawn, 0) % area.width;
+    y[index] = position.y + particle_random(index, spawn, 1) % area.height;
+    z[index] = 3 + particle_random(index, spawn, 2) % 3;
+
+    // Jumps to the new position instead of being interpolated across the screen
+    previous_x[index] = x[index];
+    previous_y[index] = y[index];
+    previous_z[index] = z[index];
+}
+
+
+void ParticleSystem::begin_frame(float elapsed_time) {
+    this->elapsed_time = elapsed_time;
+
+    // Count 1/3 of the bars of every panel as bars that represent the bass intensity. Not the best solution but works.
+    int count_bars = static_cast<int>(bars_per_panel * 0.33);
+    float bass_intensity = 0.f;
+    for (size_t panel = 0; panel < spectrum_panels.size(); panel++) {
+        for (int i = 0; i < count_bars; i++) {
+            bass_intensity += frequency_intensity_bars[panel * bars_per_panel + i].bar_target_height;
+        }
+    }
+    if (count_bars > 0) bass_intensity /= count_bars * spectrum_panels.size();
+
+    // Maps 0-50 to 20-255
+    int color_value = (int)bass_intensity * (255.f - 20.f) / 50.f + 20.f;
+    target_brightness = std::min(color_value, 255);
+
+    // The brightness moves 1% of the remaining difference per millisecond towards the target
+    brightness_step = std::min(1.f, 0.010f * elapsed_time);
+}
+
+
+void ParticleSystem::update(size_t begin, size_t end) {
+    const float center_x = (float)WIDTH  / 2.f;
+    const float center_y = (float)HEIGHT / 2.f;
+
+    float* px = x.data();
+    float* py = y.data();
+    float* pz = z.data();
+    float* pb = brightness.data();
+
+    // The state before this step, for interpolating between steps in draw()
+    std::copy(px + begin, px + end, previous_x.data() + begin);
+    std::copy(py + begin, py + end, previous_y.data() + begin);
+    std::copy(pz + begin, pz + end, previous_z.data() + begin);
+
+    size_t i = begin;
+
+    // The vector paths do the same as the scalar loop below, eight or four particles at a time
+#if defined(__AVX2__)
+    {
+        const __m256 target  = _mm256_set1_ps(target_brightness);
+        const __m256 step    = _mm256_set1_ps(brightness_step);
+        const __m256 elapsed = _mm256_set1_ps(elapsed_time);
+        const __m256 lowest  = _mm256_set1_ps(50.f);
+        const __m256 highest = _mm256_set1_ps(255.f);
+        const __m256 cx      = _mm256_set1_ps(center_x);
+        const __m256 cy      = _mm256_set1_ps(center_y);
+
+        for (; i + 8 <= end; i += 8) {
+            __m256 current = _mm256_loadu_ps(pb + i);
+            current = _mm256_add_ps(current, _mm256_mul_ps(_mm256_sub_ps(target, current), step));
+            current = _mm256_min_ps(highest, _mm256_max_ps(lowest, current));
+            _mm256_storeu_ps(pb + i, current);
+
+            __m256i index    = _mm256_cvttps_epi32(current);
+            __m256  fraction = _mm256_sub_ps(current, _mm256_cvtepi32_ps(index));
+            __m256  low      = _mm256_i32gather_ps(speed_curve, index, 4);
+            __m256  high     = _mm256_i32gather_ps(speed_curve + 1, index, 4);
+            __m256  speed    = _mm256_mul_ps(elapsed, _mm256_add_ps(low, _mm256_mul_ps(_mm256_sub_ps(high, low), fraction)));
+
+            __m256 depth = _mm256_max_ps(_mm256_setzero_ps(), _mm256_sub_ps(_mm256_loadu_ps(pz + i), speed));
+            __m256 scale = _mm256_div_ps(speed, depth);
+            _mm256_storeu_ps(pz + i, depth);
+
+            __m256 px8 = _mm256_loadu_ps(px + i);
+            __m256 py8 = _mm256_loadu_ps(py + i);
+            _mm256_storeu_ps(px + i, _mm256_add_ps(px8, _mm256_mul_ps(_mm256_sub_ps(px8, cx), scale)));
+            _mm256_storeu_ps(py + i, _mm256_add_ps(py8, _mm256_mul_ps(_mm256_sub_ps(py8, cy), scale)));
+        }
+    }
+#endif
+
+#if defined(__SSE2__)
+    {
+        const __m128 target  = _mm_set1_ps(target_brightness);
+        const __m128 step    = _mm_set1_ps(brightness_step);
+        const __m128 elapsed = _mm_set1_ps(elapsed_time);
+        const __m128 lowest  = _mm_set1_ps(50.f);
+        const __m128 highest = _mm_set1_ps(255.f);
+        const __m128 cx      = _mm_set1_ps(center_x);
+        const __m128 cy      = _mm_set1_ps(center_y);
+        alignas(16) int indices[4];
+
+        for (; i + 4 <= end; i += 4) {
+            __m128 current = _mm_loadu_ps(pb + i);
+            current = _mm_add_ps(current, _mm_mul_ps(_mm_sub_ps(target, current), step));
+            current = _mm_min_ps(highest, _mm_max_ps(lowest, current));
+            _mm_storeu_ps(pb + i, current);
+
+            // No gather instruction before AVX2
+            __m128i index = _mm_cvttps_epi32(current);
+            _mm_store_si128((__m128i*)indices, index);
+
+            __m128 fraction = _mm_sub_ps(current, _mm_cvtepi32_ps(index));
+            __m128 low      = _mm_setr_ps(speed_curve[indices[0]],     speed_curve[indices[1]],     speed_curve[indices[2]],     speed_curve[indices[3]]);
+            __m128 high     = _mm_setr_ps(speed_curve[indices[0] + 1], speed_curve[indices[1] + 1], speed_curve[indices[2] + 1], speed_curve[indices[3] + 1]);
+            __m128 speed    = _mm_mul_ps(elapsed, _mm_add_ps(low, _mm_mul_ps(_mm_sub_ps(high, low), fraction)));
+
+            __m128 depth = _mm_max_ps(_mm_setzero_ps(), _mm_sub_ps(_mm_loadu_ps(pz + i), speed));
+            __m128 scale = _mm_div_ps(speed, depth);
+            _mm_storeu_ps(pz + i, depth);
+
+            __m128 px4 = _mm_loadu_ps(px + i);
+            __m128 py4 = _mm_loadu_ps(py + i);
+            _mm_storeu_ps(px + i, _mm_add_ps(px4, _mm_mul_ps(_mm_sub_ps(px4, cx), scale)));
+            _mm_storeu_ps(py + i, _mm_add_ps(py4, _mm_mul_ps(_mm_sub_ps(py4, cy), scale)));
+        }
+    }
+#endif
+
+    for (; i < end; i++) {
+        // Update the brightness smoothly and keep it within 50-255
+        float current = pb[i] + (target_brightness - pb[i]) * brightness_step;
+        current = std::min(255.f, std::max(50.f, current));
+        pb[i] = current;
+
+        // Brighter particles move faster
+        // Max speed: elapsed_time / (25000 - 255^1.8) = elapsed_time / 3532,952...
+        // Min speed: elapsed_time / (25000 -  50^1.8) = elapsed_time / 23856,737...
+        int   index    = (int)current;
+        float fraction = current - index;
+        float curve    = speed_curve[index] + (speed_curve[index + 1] - speed_curve[index]) * fraction;
+        float speed    = elapsed_time * curve;
+
+        // Move the particle
+        float depth = std::max(0.f, pz[i] - speed);
+        float scale = speed / depth;
+        pz[i] = depth;
+        px[i] += (px[i] - center_x) * scale;
+        py[i] += (py[i] - center_y) * scale;
+    }
+
+    // Respawn the particles that left the screen. Written as a negation so that NaN positions
+    // (a particle that reached depth 0 exactly at the center) are caught as well.
+    for (size_t i = begin; i < end; i++) {
+        if (!(px[i] >= 0 && px[i] <= WIDTH && py[i] >= 0 && py[i] <= HEIGHT)) {
+            reposition(i);
+        }
+    }
+}
+
+
+void ParticleSystem::update(float elapsed_time) {
+    begin_frame(elapsed_time);
+    update(0, size());
+}
+
+
+void ParticleSystem::draw(float interpolation) {
+    for (size_t i = 0; i < size(); i++) {
+        float draw_x = previous_x[i] + (x[i] - previous_x[i]) * interpolation;
+        float draw_y = previous_y[i] + (y[i] - previous_y[i]) * interpolation;
+        float draw_z = previous_z[i] + (z[i] - previous_z[i]) * interpolation;
+
+        float alpha = 200 - ((draw_z / 2) * 200);
+        if (alpha > 200) alpha = 200;
+        else if (alpha < 1) alpha = 1;
+
+        // Calculate the new color with the alpha
+        float alpha_brightness = alpha + ((alpha / 200.f) * 255);
+        if (alpha_brightness > 255) alpha_brightness = 255;
+
+        uint8_t value = brightness[i] * (alpha_brightness / 255);
+        RGBColor blended_color = {value, value, value};  // Works on black background only!
+
+        simple_graphics::batch_rect(Position2d{(int)draw_x, (int)draw_y}, Size2d{2, 2}, blended_color);
+    }
+}
+
+
+void calculate_heights(const std::vector<double>& bin_intensities, std::vector<int>& heights) {
     
     // Map band intensities to bar heights
-    std::vector<int> heights(BAR_COUNT, 0);
+    heights.resize(bin_intensities.size());
     
     // Normalize each intensity to the fixed height
-    for (int i = 0; i < BAR_COUNT; i++) {
+    for (size_t i = 0; i < heights.size(); i++) {
         heights[i] = static_cast<int>(std::round((bin_intensities[i] / maximum_intensity) * frequency_intensity_bars[i].max_height));
     }
-
-    return heights;
     
 }
 
 
+void audio_visuals::set_band_intensities(const std::vector<double>& band_intensities, size_t panel) {
+    PROFILE_SCOPE(Heights);
+
+    static std::vector<int> heights;
+    calculate_heights(band_intensities, heights);
+
+    FreqIntensityBar* bars = &frequency_intensity_bars[panel * bars_per_panel];
+    for (size_t i = 0; i < std::min(heights.size(), bars_per_panel); i++) {
+        bars[i].bar_target_height = heights[i];
+    }
+}
+
+
 void visualize_audio() {
+    // The bar targets only change when the analysis side published a new spectrum
+    size_t panels = std::min(capture_sources.size(), spectrum_panels.size());
+
+    for (size_t i = 0; i < panels; i++) {
+        if (const BandFrame* frame = poll_band_frame(i)) {
+            audio_visuals::set_band_intensities(frame->bands, i);
+        }
+    }
+}
+
 
-    std::vector<int> heights = calculate_heights(compute_fft());
+// Advances the particles and bars by elapsed_time milliseconds. The updates are spread over the
+// job system.
+void audio_visuals::update(double elapsed_time) {
+    PROFILE_SCOPE(Update);
 
-    for (int i = 0; i < BAR_COUNT; i++) {
-        frequency_intensity_bars[i].bar_target_height = heights[i];
+    particles.begin_frame(elapsed_time);
+    job_system::parallel_for("particles", particles.size(), PARTICLE_CHUNK_SIZE, [](size_t begin, size_t end) {
+        particles.update(begin, end);
+    });
+
+    job_system::parallel_for("bars", frequency_intensity_bars.size(), BAR_CHUNK_SIZE, [elapsed_time](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            frequency_intensity_bars[i].update(elapsed_time);
+        }
+    });
+}
+
+
+void audio_visuals::draw_frame(double elapsed_time) {
+    update(elapsed_time);
+    render(1.f);
+}
+
+
+// The title, the labels and the boxes around the bars. They only change with maximum_intensity,
+// so they are drawn into a layer once and composited every frame.
+static void draw_static_layer() {
+    simple_graphics::draw_text(
+        "Audio Visualizer v1.1", Position2d{10, 10},
+        simple_graphics::font24, RGBColor{255, 255, 255}, true
+    );
+
+    std::string intensity_label = std::string("Max intensity: ") + std::to_string(maximum_intensity);
+
+    for (const SpectrumPanel& panel : spectrum_panels) {
+        const Position2d& position = panel.position;
+        const Size2d&     size     = panel.size;
+
+        if (!panel.label.empty()) {
+            simple_graphics::draw_text(
+                panel.label.c_str(),
+                Position2d{
+                    position.x - 10,
+                    position.y - 40
+                }, simple_graphics::font16, RGBColor{255, 255, 255}, true
+            );
+        }
+
+        simple_graphics::draw_text(
+            "20 Hz",
+            Position2d{
+                position.x - 70,
+                position.y + size.height/2 - 11
+            }, simple_graphics::font16, RGBColor{255, 255, 255}, true
+        );
+
+        simple_graphics::draw_text(
+            "20 kHz",
+            Position2d{
+                position.x + size.width + 20,
+                position.y + size.height/2 - 11
+            }, simple_graphics::font16, {255, 255, 255}, true
+        );
+
+        simple_graphics::draw_text(
+            intensity_label.c_str(),
+            Position2d{
+                position.x - 10,
+                position.y + size.height + 20
+            }, simple_graphics::font16, RGBColor{255, 255, 255}, true
+        );
+
+        // Draw the boxes around the audio visualizer
+        simple_graphics::draw_rect(
+            Position2d{position.x - 10, position.y - 10},
+            Size2d{size.width + 20, size.height + 20},
+            RGBColor{20, 20, 20}, true
+        );
+
+        simple_graphics::draw_rect(
+            Position2d{position.x - 10, position.y - 10},
+            Size2d{size.width + 20, size.height + 20},
+            RGBColor{150, 150, 150}, false
+        );
     }
 }
+
+
+// Draws one full frame, interpolated between the last two updates. Presenting it is left to
+// the caller.
+void audio_visuals::render(float interpolation) {
+
+    // Clear the display and draw the particles first
+    {
+        PROFILE_SCOPE(Particles);
+        simple_graphics::fill_display(RGBColor{0, 0, 0});
+        particles.draw(interpolation);
+        simple_graphics::flush_batch();  // Otherwise the particles would be submitted in the next stage
+    }
+
+    // The label shows maximum_intensity, which changes when a key is pressed
+    {
+        PROFILE_SCOPE(Text);
+
+        if (static_layer_intensity != maximum_intensity) {
+            simple_graphics::invalidate_layer(static_layer);
+            static_layer_intensity = maximum_intensity;
+        }
+
+        if (!simple_graphics::layer_valid(static_layer)) {
+            simple_graphics::begin_layer(static_layer);
+            draw_static_layer();
+            simple_graphics::end_layer();
+        }
+
+        simple_graphics::draw_layer(static_layer);
+    }
+
+    // Draw the audio visualizers
+    PROFILE_SCOPE(Bars);
+
+    for (size_t i = 0; i < frequency_intensity_bars.size(); i++) {
+        frequency_intensity_bars[i].draw(interpolation);
+    }
+
+    simple_graphics::flush_batch();
+}
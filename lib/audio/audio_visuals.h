@@ -8,9 +8,36 @@
 #define VISUALIZER_WIDTH  400
 #define VISUALIZER_HEIGHT 200
 
+// Smallest number of particles or bars updated as one job, smaller chunks cost more to
+// schedule than they save
+#define PARTICLE_CHUNK_SIZE 2048
+#define BAR_CHUNK_SIZE      64
+
+// Room around a panel for its labels. Panels shrink when the tiles leave less than that.
+#define PANEL_MARGIN_X 180
+#define PANEL_MARGIN_Y 120
+
+
+// One spectrum on the display. The bars of panel p are frequency_intensity_bars
+// [p * bars_per_panel, (p + 1) * bars_per_panel).
+struct SpectrumPanel {
+    std::string label;     // Drawn above the panel if there is more than one
+    Position2d  position;  // Top left corner of the bar area
+    Size2d      size;
+};
+
 
 namespace audio_visuals {
-    bool init();
+    // Tiles the display with one panel per label, a single panel is centered
+    bool init(const std::vector<std::string>& panel_labels = {std::string()});
+    // The simulation and the drawing can run at different rates, render() interpolates
+    // between the last two updates. draw_frame() is an update followed by a render.
+    void update(double elapsed_time);
+    void render(float interpolation);
+    void draw_frame(double elapsed_time);
+
+    // Sets the target heights of the panel's bars from one spectrum
+    void set_band_intensities(const std::vector<double>& band_intensities, size_t panel = 0);
 }
 
 
@@ -20,7 +47,9 @@ public:
     int x;
     int y;
     int bar_width;
-    int bar_height = 0;
+    // Fractional, so that the many small steps of a fixed timestep still add up
+    float bar_height = 0;
+    float previous_height = 0;  // Before the last update
     int max_height = VISUALIZER_HEIGHT;
     int bar_target_height = 0;
     RGBColor bar_color;
@@ -39,6 +68,8 @@ public:
     }
 
     void update(double elapsed_time) {
+        previous_height = bar_height;
+
         // Smooth transition logic
         double difference = bar_target_height - bar_height;
 
@@ -63,9 +94,11 @@ public:
         if (bar_height < 2) bar_height = 2;
     }
 
-    void draw() {
+    void draw(float interpolation = 1.f) {
+        int bar_height = (int)std::lround(previous_height + (this->bar_height - previous_height) * interpolation);
+
         // std::cout << "x: " << x << " y: " << y << " w: " << bar_width << " h: " << bar_height << std::endl;
-        simple_graphics::draw_rect(Position2d{x, y - (bar_height/2)}, Size2d{bar_width, bar_height}, bar_color, true);
+        simple_graphics::batch_rect(Position2d{x, y - (bar_height/2)}, Size2d{bar_width, bar_height}, bar_color);
     }
 
 };
@@ -73,112 +106,59 @@ public:
 
 extern uint maximum_intensity;
 extern std::vector<FreqIntensityBar> frequency_intensity_bars;
+extern std::vector<SpectrumPanel> spectrum_panels;
+extern size_t bars_per_panel;
 
 
-class Particle {
-
-private:
-    float x, y, z;
-    float target_brightness = 100;
-    float current_brightness = 100;
-    RGBColor color = {255, 255, 255};
-
-    void reposition() {
-        x = (WIDTH/2 - VISUALIZER_WIDTH/2) + rand() % VISUALIZER_WIDTH;
-        y = (HEIGHT/2 - VISUALIZER_HEIGHT/2) + rand() % VISUALIZER_HEIGHT;
-        z = 3 + rand() % 3;
-    }
-
-    float translate(int value, int start1, int stop1, int start2, int stop2) {
-        return (((float)value-(float)start1)/((float)stop1-(float)start1))*((float)stop2-(float)start2)+(float)start2;
-    }
-
+// Particles stored as separate arrays so the per-frame update runs over contiguous floats and
+// can be vectorized. Everything that is the same for all particles, like the bass intensity,
+// is computed once per frame in begin_frame().
+class ParticleSystem {
 
 public:
-    Particle() {
-        x = rand() % WIDTH;
-        y = rand() % HEIGHT;
-        z = 3 + rand() % 3;
-    }
+    ParticleSystem();
 
-    void update(float elapsed_time) {
-        // Make sure the particles stays within bounds
-        if (x < 0 || x > WIDTH || y < 0 || y > HEIGHT) {
-            reposition();
-            return;
-        }
+    void   resize(size_t count);
+    size_t size() const { return x.size(); }
 
-        // Count 1/3 of the bars as bars that represent the bass intensity. Not the best solution but works.
-        int count_bars = static_cast<int>(frequency_intensity_bars.size() * 0.33);
-        float bass_intensity = 0.f;
-        for (int i = 0; i < count_bars; i++) {
-            bass_intensity += frequency_intensity_bars[i].bar_target_height;
-        }
-        bass_intensity /= count_bars;
+    // Computes the frame-wide inputs from the bars, call this once per frame before update()
+    void begin_frame(float elapsed_time);
 
-        int color_value = translate(bass_intensity, 0, 50, 20, 255);
-        if (color_value > 255) color_value = 255;
-        target_brightness = color_value;
+    // Moves the particles in [begin, end). Disjoint ranges may be updated concurrently.
+    void update(size_t begin, size_t end);
 
-        // Update the brightness smoothly
-        double difference = target_brightness - current_brightness;
-        double adjustment_speed = std::fabs(difference) * 0.010;
+    // begin_frame() followed by an update of all particles
+    void update(float elapsed_time);
 
-        if (difference > 0) {
-            current_brightness += adjustment_speed * elapsed_time;
-            if (current_brightness > target_brightness) {
-                current_brightness = target_brightness;
-            }
-        } else if (difference < 0) {
-            current_brightness -= adjustment_speed * elapsed_time;
-            if (current_brightness < target_brightness) {
-                current_brightness = target_brightness;
-            }
-        }
-
-        // Ensure the brightness stays within range 50-255
-        if (current_brightness > 255) current_brightness = 255;
-        if (current_brightness < 50) current_brightness = 50;
-
-        // Move the particle
-        // Max speed: elapsed_time / (25000 - 255^1.8) = elapsed_time / 3532,952...
-        // Min speed: elapsed_time / (25000 -  50^1.8) = elapsed_time / 23856,737...
+    // Interpolation 0 draws the particles as they were before the last update, 1 as they are now
+    void draw(float interpolation = 1.f);
 
-        float speed = elapsed_time / (25000 - pow(current_brightness, 1.8));
 
-        z -= speed;
-        if (z < 0) z = 0;
-        x += (x - (float)WIDTH / 2.f) * (speed / z);
-        y += (y - (float)HEIGHT / 2.f) * (speed / z);
-
-    }
-
-    void draw() {
-        float alpha = 200 - ((z / 2) * 200);
-        if (alpha > 200) alpha = 200;
-        else if (alpha < 1) alpha = 1;
-
-        // Calculate the new color with the alpha
-        float brightness = alpha + ((alpha / 200.f) * 255);
-        if (brightness > 255) brightness = 255;
-        else if (brightness < 0) brightness = 0;
+private:
+    std::vector<float> x, y, z;
+    std::vector<float> previous_x, previous_y, previous_z;
+    std::vector<float> brightness;
+    std::vector<uint32_t> spawns;  // Respawns of every particle, seeds its next position
 
-        float alpha_normalized = brightness / 255;
+    // Frame-wide inputs
+    float target_brightness = 100;
+    float brightness_step   = 0;
+    float elapsed_time      = 0;
 
-        RGBColor blended_color = {  // Works on black background only!
-            current_brightness * alpha_normalized,
-            current_brightness * alpha_normalized,
-            current_brightness * alpha_normalized
-        };
+    // 1 / (25000 - brightness^1.8) for every integer brightness, the particle speed per
+    // millisecond. Interpolated between the entries.
+    float speed_curve[257];
 
-        simple_graphics::draw_rect(Position2d{(int)x, (int)y}, Size2d{2, 2}, blended_color, true);
-    }
+    void reposition(size_t index);
 
 };
 
+// Writes one bar height per band into heights, which only allocates the first time
+void calculate_heights(const std::vector<double>& bin_intensities, std::vector<int>& heights);
+// Picks up the newest spectrum of every capture source for its panel
 void visualize_audio();
 
-extern std::vector<Particle> particles;
+extern ParticleSystem particles;
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,66 @@
+#include "band_table.h"
+
+
+std::vector<FrequencyBand> generate_frequency_bands(int num_bins, float start_freq, float end_freq) {
+    std::vector<FrequencyBand> frequency_bands(num_bins);
+
+    // Logarithmic scale
+    for (int i = 0; i < num_bins; i++) {
+        float lower = start_freq * pow(end_freq / start_freq, static_cast<float>(i) / num_bins);
+        float upper = start_freq * pow(end_freq / start_freq, static_cast<float>(i + 1) / num_bins);
+        frequency_bands[i] = { lower, upper };
+    }
+
+    return frequency_bands;
+}
+
+
+void BandTable::build(const std::vector<FrequencyBand>& bands, int fft_size, unsigned int sample_rate, int first_band) {
+    this->fft_size    = fft_size;
+    this->sample_rate = sample_rate;
+
+    int band_count = bands.size();
+    int last_bin = fft_size / 2;
+    double freq_resolution = static_cast<double>(sample_rate) / fft_size;
+
+    first_bin.assign(band_count, 0);
+    bin_count.assign(band_count, 0);
+    weight_offset.assign(band_count, 0);
+    scale.assign(band_count, 0.0);
+    weights.clear();
+
+    lowest_bin  = last_bin;
+    highest_bin = 0;
+
+    for (int band = 0; band < band_count; band++) {
+        // Band edges in units of bins. Bin k covers the range [k - 0.5, k + 0.5).
+        double lower = bands[band].lower_freq / freq_resolution;
+        double upper = bands[band].upper_freq / freq_resolution;
+
+        int start = std::clamp(static_cast<int>(std::floor(lower + 0.5)), 0, last_bin);
+        int end   = std::clamp(static_cast<int>(std::ceil(upper - 0.5)), start, last_bin);
+
+        weight_offset[band] = weights.size();
+        first_bin[band]     = start;
+        bin_count[band]     = end - start + 1;
+
+        double total_weight = 0.0;
+        for (int bin = start; bin <= end; bin++) {
+            double overlap = std::min(upper, bin + 0.5) - std::max(lower, bin - 0.5);
+            double weight = std::clamp(overlap, 0.0, 1.0);
+
+            weights.push_back(weight);
+            total_weight += weight;
+        }
+
+        // Average over the band, then boost higher frequencies more aggressively
+        double custom_scale_factor = (1.0 + (double)(first_band + band) / 10.0);
+        scale[band] = (total_weight > 0.0 ? 1.0 / total_weight : 0.0) * custom_scale_factor;
+
+        lowest_bin  = std::min(lowest_bin, start);
+        highest_bin = std::max(highest_bin, end);
+    }
+
+    magnitudes.assign(std::max(0, highest_bin - lowest_bin + 1), 0);
+}
+
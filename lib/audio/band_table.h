@@ -0,0 +1,69 @@
+#ifndef _BAND_TABLE_H_
+#define _BAND_TABLE_H_
+
+
+#include "../main.h"
+#include "fft_engine.h"
+#include "dsp_kernels.h"
+
+
+struct FrequencyBand {
+    float lower_freq;
+    float upper_freq;
+};
+
+
+std::vector<FrequencyBand> generate_frequency_bands(int num_bins, float start_freq, float end_freq);
+
+
+// Precomputed mapping from FFT bins to frequency bands. Every band covers a contiguous run of
+// bins, and the bins at the band edges are weighted by how much of them lies inside the band.
+// Bands narrower than a single bin therefore still get a value instead of none at all.
+class BandTable {
+
+public:
+    // first_band is the index of bands[0] among all bands, if the table only covers some of them
+    void build(const std::vector<FrequencyBand>& bands, int fft_size, unsigned int sample_rate, int first_band = 0);
+
+    // Computes the magnitudes of the used bins in one pass and writes one intensity per band.
+    // Bands can fix the band count at compile time, it must then match the table.
+    template <int Bands = 0>
+    void aggregate(const fft_complex* spectrum, double* band_intensities) {
+        const int bands = Bands > 0 ? Bands : band_count();
+
+        complex_magnitudes(spectrum + lowest_bin, magnitudes.size(), magnitudes.data());
+
+        for (int band = 0; band < bands; band++) {
+            const fft_real* band_magnitudes = magnitudes.data() + (first_bin[band] - lowest_bin);
+            double sum = weighted_sum(band_magnitudes, weights.data() + weight_offset[band], bin_count[band]);
+
+            band_intensities[band] = sum * scale[band];
+        }
+    }
+
+    bool matches(int fft_size, unsigned int sample_rate) const {
+        return this->fft_size == fft_size && this->sample_rate == sample_rate;
+    }
+
+    int band_count() const { return (int)first_bin.size(); }
+
+
+private:
+    int fft_size = 0;
+    unsigned int sample_rate = 0;
+
+    int lowest_bin  = 0;  // Range of bins used by any band
+    int highest_bin = -1;
+
+    std::vector<int>    first_bin;  // Per band
+    std::vector<int>    bin_count;
+    std::vector<int>    weight_offset;
+    std::vector<double> scale;
+
+    std::vector<fft_real> weights;    // Per band, per bin
+    std::vector<fft_real> magnitudes; // Scratch for the used bins
+
+};
+
+
+#endif
@@ -0,0 +1,203 @@
+#ifndef _DSP_KERNELS_H_
+#define _DSP_KERNELS_H_
+
+
+#include "../main.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+// Vectorized stereo part of downmix_pre_emphasis(). Returns the number of frames processed.
+inline int downmix_pre_emphasis_stereo(const short* input, int frames, double alpha, double& prev_sample, double* output) {
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d a    = _mm_set1_pd(alpha);
+    __m128d last       = _mm_set1_pd(prev_sample);
+
+    for (; i + 4 <= frames; i += 4) {
+        // Summing adjacent int16 pairs gives left + right as int32 for four frames
+        __m128i sums = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(input + 2 * i)), ones);
+
+        __m128d x01 = _mm_mul_pd(_mm_cvtepi32_pd(sums), half);
+        __m128d x23 = _mm_mul_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(sums, _MM_SHUFFLE(1, 0, 3, 2))), half);
+
+        // The same samples delayed by one
+        __m128d d01 = _mm_shuffle_pd(last, x01, 1);
+        __m128d d23 = _mm_shuffle_pd(x01, x23, 1);
+
+        _mm_storeu_pd(output + i,     _mm_sub_pd(x01, _mm_mul_pd(a, d01)));
+        _mm_storeu_pd(output + i + 2, _mm_sub_pd(x23, _mm_mul_pd(a, d23)));
+
+        last = x23;
+    }
+
+    prev_sample = _mm_cvtsd_f64(_mm_unpackhi_pd(last, last));
+#endif
+
+    return i;
+}
+
+
+inline int downmix_pre_emphasis_stereo(const short* input, int frames, float alpha, float& prev_sample, float* output) {
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128  half = _mm_set1_ps(0.5f);
+    const __m128  a    = _mm_set1_ps(alpha);
+    __m128 last        = _mm_set1_ps(prev_sample);
+
+    for (; i + 4 <= frames; i += 4) {
+        __m128i sums = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(input + 2 * i)), ones);
+        __m128 x = _mm_mul_ps(_mm_cvtepi32_ps(sums), half);
+
+        // [last3 last3 x0 x0] -> [last3 x0 x1 x2]
+        __m128 t = _mm_shuffle_ps(last, x, _MM_SHUFFLE(0, 0, 3, 3));
+        __m128 delayed = _mm_shuffle_ps(t, x, _MM_SHUFFLE(2, 1, 2, 0));
+
+        _mm_storeu_ps(output + i, _mm_sub_ps(x, _mm_mul_ps(a, delayed)));
+
+        last = x;
+    }
+
+    prev_sample = _mm_cvtss_f32(_mm_shuffle_ps(last, last, _MM_SHUFFLE(3, 3, 3, 3)));
+#endif
+
+    return i;
+}
+
+
+// Converts interleaved int16 frames to mono and applies the pre-emphasis filter
+// y[n] = x[n] - alpha * x[n - 1] in a single pass. prev_sample holds x[n - 1] and carries the
+// filter state over to the next call. A nonzero Channels fixes the channel count at compile
+// time so the mixing loop can be unrolled, otherwise the runtime `channels` is used. The stereo
+// case is vectorized.
+template <int Channels = 0, typename T>
+inline void downmix_pre_emphasis(const short* input, int frames, int channels, T alpha, T& prev_sample, T* output) {
+    const int channel_count = Channels > 0 ? Channels : channels;
+    int i = 0;
+
+    if (channel_count == 2) {
+        i = downmix_pre_emphasis_stereo(input, frames, alpha, prev_sample, output);
+    }
+
+    const T scale = T(1) / channel_count;
+
+    for (; i < frames; i++) {
+        int sum = 0;
+        for (int channel = 0; channel < channel_count; channel++) {
+            sum += input[i * channel_count + channel];
+        }
+
+        T current_sample = sum * scale;
+        output[i] = current_sample - alpha * prev_sample;
+        prev_sample = current_sample;
+    }
+}
+
+
+// Multiplies samples by the window, written so the compiler can vectorize it
+template <typename T>
+inline void apply_window(const T* __restrict samples, const T* __restrict window, int count, T* __restrict output) {
+    for (int i = 0; i < count; i++) {
+        output[i] = samples[i] * window[i];
+    }
+}
+
+
+// Magnitudes of `count` complex FFTW bins. Uses AVX2 or SSE2 when the compiler targets them
+// and finishes the remaining bins with scalar code.
+inline void complex_magnitudes(const fftw_complex* bins, int count, double* magnitudes) {
+    const double* in = &bins[0][0];
+    int i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 4 <= count; i += 4) {
+        __m256d a = _mm256_loadu_pd(in + 2 * i);      // r0 i0 r1 i1
+        __m256d b = _mm256_loadu_pd(in + 2 * i + 4);  // r2 i2 r3 i3
+        a = _mm256_mul_pd(a, a);
+        b = _mm256_mul_pd(b, b);
+
+        // Unpacking works within 128-bit lanes, so the bins come out as 0 2 1 3
+        __m256d sum = _mm256_add_pd(_mm256_unpacklo_pd(a, b), _mm256_unpackhi_pd(a, b));
+        __m256d magnitude = _mm256_sqrt_pd(sum);
+        _mm256_storeu_pd(magnitudes + i, _mm256_permute4x64_pd(magnitude, 0xD8));
+    }
+#endif
+
+#if defined(__SSE2__)
+    for (; i + 2 <= count; i += 2) {
+        __m128d a = _mm_loadu_pd(in + 2 * i);      // r0 i0
+        __m128d b = _mm_loadu_pd(in + 2 * i + 2);  // r1 i1
+        a = _mm_mul_pd(a, a);
+        b = _mm_mul_pd(b, b);
+
+        __m128d sum = _mm_add_pd(_mm_unpacklo_pd(a, b), _mm_unpackhi_pd(a, b));
+        _mm_storeu_pd(magnitudes + i, _mm_sqrt_pd(sum));
+    }
+#endif
+
+    for (; i < count; i++) {
+        magnitudes[i] = sqrt(in[2 * i] * in[2 * i] + in[2 * i + 1] * in[2 * i + 1]);
+    }
+}
+
+
+inline void complex_magnitudes(const fftwf_complex* bins, int count, float* magnitudes) {
+    const float* in = &bins[0][0];
+    int i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 8 <= count; i += 8) {
+        __m256 a = _mm256_loadu_ps(in + 2 * i);      // r0 i0 r1 i1 | r2 i2 r3 i3
+        __m256 b = _mm256_loadu_ps(in + 2 * i + 8);  // r4 i4 r5 i5 | r6 i6 r7 i7
+        a = _mm256_mul_ps(a, a);
+        b = _mm256_mul_ps(b, b);
+
+        // Shuffling works within 128-bit lanes, so the bins come out as 0 1 4 5 2 3 6 7
+        __m256 real = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 imag = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        __m256 magnitude = _mm256_sqrt_ps(_mm256_add_ps(real, imag));
+        __m256d ordered = _mm256_permute4x64_pd(_mm256_castps_pd(magnitude), 0xD8);
+        _mm256_storeu_ps(magnitudes + i, _mm256_castpd_ps(ordered));
+    }
+#endif
+
+#if defined(__SSE2__)
+    for (; i + 4 <= count; i += 4) {
+        __m128 a = _mm_loadu_ps(in + 2 * i);      // r0 i0 r1 i1
+        __m128 b = _mm_loadu_ps(in + 2 * i + 4);  // r2 i2 r3 i3
+        a = _mm_mul_ps(a, a);
+        b = _mm_mul_ps(b, b);
+
+        __m128 real = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 imag = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        _mm_storeu_ps(magnitudes + i, _mm_sqrt_ps(_mm_add_ps(real, imag)));
+    }
+#endif
+
+    for (; i < count; i++) {
+        magnitudes[i] = sqrtf(in[2 * i] * in[2 * i] + in[2 * i + 1] * in[2 * i + 1]);
+    }
+}
+
+
+// Weighted sum of `count` values
+template <typename T>
+inline double weighted_sum(const T* values, const T* weights, int count) {
+    T sum = 0;
+
+    for (int i = 0; i < count; i++) {
+        sum += values[i] * weights[i];
+    }
+
+    return sum;
+}
+
+
+#endif
@@ -0,0 +1,70 @@
+#include "fft_engine.h"
+
+
+static bool wisdom_loaded = false;
+
+
+FFTEngine::~FFTEngine() {
+    release();
+}
+
+
+bool FFTEngine::prepare(int frame_size) {
+    if (plan != nullptr && this->frame_size == frame_size) {
+        return true;  // Already planned for this size
+    }
+
+    release();
+
+    if (!wisdom_loaded) {
+        if (FFTW(import_wisdom_from_filename)(FFT_WISDOM_FILE)) {
+            std::cout << GREEN << "[FFT INFO]" << CLEAR << " Loaded FFTW wisdom from " << FFT_WISDOM_FILE << "." << std::endl;
+        }
+        wisdom_loaded = true;
+    }
+
+    in  = (fft_real*) FFTW(malloc)(sizeof(fft_real) * frame_size);
+    out = (fft_complex*) FFTW(malloc)(sizeof(fft_complex) * (frame_size / 2 + 1));
+
+    if (in == nullptr || out == nullptr) {
+        std::cout << RED << "[FFT ERROR]" << CLEAR << " Unable to allocate FFT buffers." << std::endl;
+        release();
+        return false;
+    }
+
+    // Planning with FFTW_MEASURE overwrites the buffers, so this must happen before they are filled
+    plan = FFTW(plan_dft_r2c_1d)(frame_size, in, out, FFT_PLANNER_FLAGS);
+    if (plan == nullptr) {
+        std::cout << RED << "[FFT ERROR]" << CLEAR << " Unable to create FFT plan for " << frame_size << " samples." << std::endl;
+        release();
+        return false;
+    }
+
+    std::fill(in, in + frame_size, fft_real(0));
+    this->frame_size = frame_size;
+
+    if (!FFTW(export_wisdom_to_filename)(FFT_WISDOM_FILE)) {
+        std::cout << YELLOW << "[FFT WARN]" << CLEAR << " Unable to save FFTW wisdom to " << FFT_WISDOM_FILE << "." << std::endl;
+    }
+
+    std::cout << GREEN << "[FFT INFO]" << CLEAR << " FFT planned for " << frame_size << " samples." << std::endl;
+
+    return true;
+}
+
+
+void FFTEngine::execute() {
+    FFTW(execute)(plan);
+}
+
+
+void FFTEngine::release() {
+    if (plan) FFTW(destroy_plan)(plan);
+    if (in)   FFTW(free)(in);
+    if (out)  FFTW(free)(out);
+
+    plan       = nullptr;
+    in         = nullptr;
+    out        = nullptr;
+    frame_size = 0;
+}
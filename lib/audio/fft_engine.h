@@ -0,0 +1,62 @@
+#ifndef _FFT_ENGINE_H_
+#define _FFT_ENGINE_H_
+
+
+#include "../main.h"
+
+
+// Uncomment to run the analysis in single precision. This halves the memory bandwidth of the
+// DSP pipeline, which is plenty accurate for visualization.
+//#define FFT_SINGLE_PRECISION
+
+// FFTW_PATIENT gives slightly faster plans but planning takes a lot longer on the first run.
+// The result is cached in the wisdom file, so later runs start up quickly either way.
+#define FFT_PLANNER_FLAGS FFTW_MEASURE
+
+
+#ifdef FFT_SINGLE_PRECISION
+typedef float         fft_real;
+typedef fftwf_complex fft_complex;
+typedef fftwf_plan    fft_plan;
+#define FFTW(name)    fftwf_##name
+#define FFT_WISDOM_FILE "fftwf_wisdom.dat"
+#else
+typedef double        fft_real;
+typedef fftw_complex  fft_complex;
+typedef fftw_plan     fft_plan;
+#define FFTW(name)    fftw_##name
+#define FFT_WISDOM_FILE "fftw_wisdom.dat"
+#endif
+
+
+// Owns the aligned FFTW buffers and a real-to-complex plan. The plan is created once and only
+// rebuilt if the frame size changes, so executing a transform costs no allocations or planning.
+class FFTEngine {
+
+public:
+    FFTEngine() = default;
+    ~FFTEngine();
+
+    FFTEngine(const FFTEngine&) = delete;
+    FFTEngine& operator=(const FFTEngine&) = delete;
+
+    bool prepare(int frame_size);
+    void execute();
+    void release();
+
+    fft_real*    input()  { return in; }
+    fft_complex* output() { return out; }
+    int          size()   const { return frame_size; }
+    int          bins()   const { return frame_size / 2 + 1; }
+
+
+private:
+    int          frame_size = 0;
+    fft_real*    in         = nullptr;
+    fft_complex* out        = nullptr;
+    fft_plan     plan       = nullptr;
+
+};
+
+
+#endif
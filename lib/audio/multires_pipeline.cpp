@@ -0,0 +1,238 @@
+#include "multires_pipeline.h"
+
+
+void HalfbandDecimator::prepare(int max_input) {
+    const int taps   = MULTIRES_DECIMATOR_TAPS;
+    const int center = taps / 2;
+
+    // Windowed sinc with the cutoff at a quarter of the input rate
+    std::vector<double> coefficients(taps);
+    double sum = 0.0;
+
+    for (int i = 0; i < taps; i++) {
+        double x = (i - center) / 2.0;
+        double sinc = x == 0.0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+        double phase = 2.0 * M_PI * i / (taps - 1);
+        double blackman = 0.42 - 0.5 * cos(phase) + 0.08 * cos(2 * phase);
+
+        coefficients[i] = 0.5 * sinc * blackman;
+        sum += coefficients[i];
+    }
+
+    // Unity gain at DC, so the levels' intensities stay comparable
+    center_tap = coefficients[center] / sum;
+
+    side_taps.clear();
+    for (int offset = 1; offset <= center; offset += 2) {
+        side_taps.push_back(coefficients[center + offset] / sum);
+    }
+
+    buffer.assign(taps - 1 + max_input, 0);
+}
+
+
+void HalfbandDecimator::process(const fft_real* input, int count, fft_real* output) {
+    const int history = MULTIRES_DECIMATOR_TAPS - 1;
+    const int center  = MULTIRES_DECIMATOR_TAPS / 2;
+
+    std::copy(input, input + count, &buffer[history]);
+
+    // Every second output of the filter, centered on buffer[center + i]
+    for (int i = 1, out = 0; i < count; i += 2, out++) {
+        const fft_real* middle = &buffer[center + i];
+        fft_real sum = center_tap * middle[0];
+
+        for (size_t tap = 0; tap < side_taps.size(); tap++) {
+            int offset = 2 * (int)tap + 1;
+            sum += side_taps[tap] * (middle[-offset] + middle[offset]);
+        }
+
+        output[out] = sum;
+    }
+
+    std::copy(&buffer[count], &buffer[count + history], &buffer[0]);
+}
+
+
+bool MultiresolutionPipeline::prepare() {
+    frequency_bands = generate_frequency_bands(config.band_count, config.min_freq, config.max_freq);
+
+    // Every level needs a whole number of samples per hop
+    int level_count = MULTIRES_MAX_LEVELS;
+    while (level_count > 1 && config.hop_size % (1 << (level_count - 1)) != 0) {
+        level_count--;
+    }
+
+    levels.clear();
+    for (int k = 0; k < level_count; k++) {
+        levels.push_back(std::make_unique<Level>());
+    }
+
+    // Only the levels down to the deepest one some band needs are kept
+    assign_bands(sample_rate.load(std::memory_order_relaxed));
+
+    int used = 1;
+    for (int k = 0; k < level_count; k++) {
+        if (levels[k]->band_count > 0) used = k + 1;
+    }
+    levels.resize(used);
+
+    for (int k = 0; k < used; k++) {
+        Level& level = *levels[k];
+        int level_hop = config.hop_size >> k;
+
+        if (!level.fft_engine.prepare(config.fft_size) || !level.stft.configure(config.fft_size, level_hop, config.window)) {
+            return false;
+        }
+
+        level.samples.assign(level_hop, 0);
+        level.decimator.prepare(level_hop);
+        level.due = true;
+    }
+
+    hop_samples.assign(config.hop_size, 0);
+    intensities.assign(config.band_count, 0.0);
+    hops = 0;
+
+    for (int k = 0; k < used; k++) {
+        const Level& level = *levels[k];
+        if (level.band_count == 0) continue;
+
+        double resolution = (double)assigned_rate / (1 << k) / config.fft_size;
+        std::cout << GREEN << "[AN INFO]" << CLEAR << " Multiresolution level " << k << ": bands " << level.first_band
+                  << "-" << level.first_band + level.band_count - 1 << " with " << resolution << " Hz bins." << std::endl;
+    }
+
+    return true;
+}
+
+
+void MultiresolutionPipeline::assign_bands(unsigned int rate) {
+    assigned_rate = rate;
+
+    for (std::unique_ptr<Level>& level : levels) {
+        level->band_count = 0;
+    }
+
+    // Deeper levels have finer bins but a lower Nyquist frequency. The chosen level only ever
+    // gets deeper towards the lower bands, so every level covers a contiguous run of them.
+    for (int band = config.band_count - 1; band >= 0; band--) {
+        const FrequencyBand& frequencies = frequency_bands[band];
+        int k = 0;
+
+        while (k + 1 < (int)levels.size()) {
+            double resolution = (double)rate / (1 << k) / config.fft_size;
+            if ((frequencies.upper_freq - frequencies.lower_freq) / resolution >= MULTIRES_MIN_BINS) break;
+
+            double next_rate = (double)rate / (1 << (k + 1));
+            if (frequencies.upper_freq > MULTIRES_USABLE_BANDWIDTH * next_rate) break;
+
+            k++;
+        }
+
+        Level& level = *levels[k];
+        level.first_band = band;
+        level.band_count++;
+    }
+
+    for (int k = 0; k < (int)levels.size(); k++) {
+        Level& level = *levels[k];
+        if (level.band_count == 0) continue;
+
+        std::vector<FrequencyBand> bands(frequency_bands.begin() + level.first_band,
+                                         frequency_bands.begin() + level.first_band + level.band_count);
+        level.band_table.build(bands, config.fft_size, rate >> k, level.first_band);
+        level.due = true;
+    }
+}
+
+
+bool MultiresolutionPipeline::process(PCMRingBuffer& ring, double* band_intensities) {
+    // Same as SpecializedPipeline::process(), except that the hop is downmixed into
+    // hop_samples first, since it feeds every level
+    bool new_frame = false;
+    PCMRingBuffer::View view;
+
+    while (ring.peek(view, config.hop_size)) {
+        fft_real state = prev_sample;
+        downmix_pre_emphasis(view.first, view.first_frames, config.channels, PRE_EMPHASIS, state, hop_samples.data());
+        downmix_pre_emphasis(view.second, view.second_frames, config.channels, PRE_EMPHASIS, state, hop_samples.data() + view.first_frames);
+
+        if (!ring.consume(view)) {
+            continue;
+        }
+
+        prev_sample = state;
+        feed_hop();
+        new_frame = true;
+    }
+
+    if (!new_frame) {
+        return false;
+    }
+
+    transform(band_intensities);
+    return true;
+}
+
+
+void MultiresolutionPipeline::process_hop(const short* frames, double* band_intensities) {
+    downmix_pre_emphasis(frames, config.hop_size, config.channels, PRE_EMPHASIS, prev_sample, hop_samples.data());
+    feed_hop();
+
+    transform(band_intensities);
+}
+
+
+// Stages the hop at every level, decimating it on the way down
+void MultiresolutionPipeline::feed_hop() {
+    const fft_real* samples = hop_samples.data();
+    int count = config.hop_size;
+
+    for (size_t k = 0; k < levels.size(); k++) {
+        Level& level = *levels[k];
+
+        level.stft.stage_samples(samples, count);
+        level.stft.commit_hop();
+
+        if (hops % (1ull << k) == 0) level.due = true;
+
+        if (k + 1 < levels.size()) {
+            Level& next = *levels[k + 1];
+            level.decimator.process(samples, count, next.samples.data());
+
+            samples = next.samples.data();
+            count  /= 2;
+        }
+    }
+
+    hops++;
+}
+
+
+void MultiresolutionPipeline::transform(double* band_intensities) {
+    unsigned int rate = sample_rate.load(std::memory_order_relaxed);
+    if (rate != assigned_rate) {
+        assign_bands(rate);
+    }
+
+    for (std::unique_ptr<Level>& level : levels) {
+        if (!level->due || level->band_count == 0) continue;
+
+        level->stft.windowed_frame(level->fft_engine.input());
+
+        {
+            PROFILE_SCOPE(Fft);
+            level->fft_engine.execute();
+        }
+
+        {
+            PROFILE_SCOPE(BandMapping);
+            level->band_table.aggregate(level->fft_engine.output(), &intensities[level->first_band]);
+        }
+
+        level->due = false;
+    }
+
+    std::copy(intensities.begin(), intensities.end(), band_intensities);
+}
@@ -0,0 +1,95 @@
+#ifndef _MULTIRES_PIPELINE_H_
+#define _MULTIRES_PIPELINE_H_
+
+
+#include "analysis_pipeline.h"
+
+
+// Decimation levels, level k runs at 1/2^k of the sample rate. The hop size must be divisible
+// by 2^(levels - 1), otherwise fewer levels are used.
+#define MULTIRES_MAX_LEVELS 5
+
+// A band is analyzed at the first level where it spans at least this many bins
+#define MULTIRES_MIN_BINS 2.0
+
+// Only the part of a level's spectrum below this fraction of its sample rate is free of
+// aliasing from the decimation filter
+#define MULTIRES_USABLE_BANDWIDTH 0.38
+
+// Length of the halfband lowpass in front of every decimation, must be 4n + 3
+#define MULTIRES_DECIMATOR_TAPS 47
+
+
+// Halves the sample rate of a stream: halfband lowpass, then every second sample. The filter
+// state carries over between calls, so a stream can be fed one hop at a time.
+class HalfbandDecimator {
+
+public:
+    void prepare(int max_input);
+
+    // count must be even, writes count / 2 samples
+    void process(const fft_real* input, int count, fft_real* output);
+
+
+private:
+    // Every second tap of a halfband filter is zero. The center tap is 0.5, the others are
+    // symmetric, so only one side of the odd ones is kept.
+    fft_real              center_tap = 0.5;
+    std::vector<fft_real> side_taps;
+
+    // MULTIRES_DECIMATOR_TAPS - 1 samples of the previous call followed by the new input
+    std::vector<fft_real> buffer;
+
+};
+
+
+// Octave-wise multiresolution analysis. The hop is decimated by 2 once per level, and every
+// level runs its own FFT of fft_size samples, so level k has 2^k times finer bins over a 2^k
+// times longer window. The wide high bands stay at full rate with short windows, the narrow
+// bass bands move down to the first level where they span MULTIRES_MIN_BINS bins instead of
+// one or none.
+//
+// Level k slides by only hop_size / 2^k samples per hop, so it is transformed every 2^k hops,
+// which keeps the cost below two FFTs of fft_size per hop.
+class MultiresolutionPipeline : public AnalysisPipeline {
+
+public:
+    using AnalysisPipeline::AnalysisPipeline;
+
+    bool prepare() override;
+    bool process(PCMRingBuffer& ring, double* band_intensities) override;
+    void process_hop(const short* frames, double* band_intensities) override;
+
+    const char* name() const override { return "multiresolution"; }
+
+
+private:
+    struct Level {
+        FFTEngine         fft_engine;
+        STFT              stft;
+        BandTable         band_table;
+        HalfbandDecimator decimator;  // Into the next level
+
+        int  first_band = 0;  // The bands analyzed at this level are contiguous
+        int  band_count = 0;
+        bool due        = true;
+
+        std::vector<fft_real> samples;  // The current hop at the level's sample rate
+    };
+
+    std::vector<std::unique_ptr<Level>> levels;
+    std::vector<fft_real> hop_samples;  // Downmixed hop at full rate
+    std::vector<double>   intensities;  // Of every band, levels that weren't due keep theirs
+    unsigned int assigned_rate = 0;
+    uint64_t     hops          = 0;
+
+    // Picks the level of every band for the given sample rate, within levels.size() levels
+    void assign_bands(unsigned int rate);
+
+    void feed_hop();
+    void transform(double* band_intensities);
+
+};
+
+
+#endif
@@ -0,0 +1,112 @@
+#include "offline_analysis.h"
+#include "analysis_pipeline.h"
+#include "audio_capture.h"
+#include "pcm_file.h"
+#include "../settings.h"
+
+
+// Binary output: this header followed by band_count float32 intensities per frame
+struct OfflineOutputHeader {
+    char     magic[4] = {'A', 'V', 'B', 'I'};
+    uint32_t version = 1;
+    uint32_t band_count;
+    uint32_t sample_rate;
+    uint32_t hop_size;
+};
+
+
+static bool ends_with(const std::string& text, const std::string& suffix) {
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+
+bool run_offline_analysis(const std::string& input_path, const std::string& output_path) {
+    std::cout << GREEN << "[OA INFO]" << CLEAR << " Offline analysis of " << input_path << "..." << std::endl;
+
+    PCMFile file;
+    if (!file.open(input_path, settings.channels, settings.sample_rate)) {
+        return false;
+    }
+
+    // The format of the file wins over the configured capture format
+    AnalysisConfig config;
+    if (!make_analysis_config(config)) {
+        return false;
+    }
+
+    config.channels    = file.channels();
+    config.sample_rate = file.sample_rate();
+
+    std::unique_ptr<AnalysisPipeline> pipeline = create_analysis_pipeline(config);
+    if (!pipeline->prepare()) {
+        return false;
+    }
+
+    bool binary = ends_with(output_path, ".bin");
+    std::ofstream output;
+
+    if (!output_path.empty()) {
+        output.open(output_path, binary ? std::ios::binary : std::ios::out);
+        if (!output) {
+            std::cout << RED << "[OA ERROR]" << CLEAR << " Unable to open " << output_path << " for writing." << std::endl;
+            return false;
+        }
+
+        if (binary) {
+            OfflineOutputHeader header;
+            header.band_count  = config.band_count;
+            header.sample_rate = config.sample_rate;
+            header.hop_size    = config.hop_size;
+            output.write((const char*)&header, sizeof(header));
+        } else {
+            output << "frame,time_s";
+            for (int band = 0; band < config.band_count; band++) output << ",band_" << band;
+            output << "\n";
+        }
+    }
+
+    std::vector<double> band_intensities(config.band_count, 0.0);
+    std::vector<float>  binary_row(config.band_count);
+
+    size_t hop_count = file.frame_count() / config.hop_size;
+    auto start_time = std::chrono::steady_clock::now();
+
+    for (size_t hop = 0; hop < hop_count && !PROCESS_INTERRUPTED; hop++) {
+        const short* frames = file.frames() + hop * config.hop_size * config.channels;
+        pipeline->process_hop(frames, band_intensities.data());
+
+        if (!output.is_open()) continue;
+
+        if (binary) {
+            std::copy(band_intensities.begin(), band_intensities.end(), binary_row.begin());
+            output.write((const char*)binary_row.data(), binary_row.size() * sizeof(float));
+        } else {
+            // Time at the end of the analyzed window
+            output << hop << "," << (double)(hop + 1) * config.hop_size / config.sample_rate;
+            for (double intensity : band_intensities) output << "," << intensity;
+            output << "\n";
+        }
+    }
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    double audio_seconds = (double)file.frame_count() / config.sample_rate;
+
+    // Without a single hop there is no rate to speak of
+    if (hop_count == 0) {
+        std::cout << YELLOW << "[OA WARN]" << CLEAR << " " << input_path << " is shorter than one hop (" << audio_seconds << " s of audio), nothing was analyzed." << std::endl;
+    } else {
+        std::cout << GREEN << "[OA INFO]" << CLEAR << " Analyzed " << hop_count << " frames (" << audio_seconds << " s of audio) in "
+                  << elapsed.count() << " s: " << hop_count / elapsed.count() << " frames/s, "
+                  << audio_seconds / elapsed.count() << "x real time." << std::endl;
+    }
+
+    if (output.is_open()) {
+        output.close();
+        if (!output) {
+            std::cout << RED << "[OA ERROR]" << CLEAR << " Failed to write " << output_path << "." << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,15 @@
+#ifndef _OFFLINE_ANALYSIS_H_
+#define _OFFLINE_ANALYSIS_H_
+
+
+#include "../main.h"
+
+
+// Runs the analysis pipeline over a WAV or raw PCM file as fast as possible, without audio
+// devices or a window. Every hop produces one row of band intensities, written to output_path
+// as CSV, or as binary if the path ends in ".bin". An empty output path only measures the
+// throughput. Returns false on error.
+bool run_offline_analysis(const std::string& input_path, const std::string& output_path);
+
+
+#endif
@@ -0,0 +1,130 @@
+#include "pcm_file.h"
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+static uint16_t read_u16(const uint8_t* bytes) {
+    return bytes[0] | (bytes[1] << 8);
+}
+
+
+static uint32_t read_u32(const uint8_t* bytes) {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+}
+
+
+PCMFile::~PCMFile() {
+    close();
+}
+
+
+bool PCMFile::open(const std::string& path, unsigned int raw_channels, unsigned int raw_sample_rate) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << RED << "[PCM ERROR]" << CLEAR << " Unable to open " << path << "." << std::endl;
+        return false;
+    }
+
+    struct stat file_info;
+    if (fstat(fd, &file_info) < 0 || file_info.st_size == 0) {
+        std::cout << RED << "[PCM ERROR]" << CLEAR << " " << path << " is empty or unreadable." << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    mapping_size = file_info.st_size;
+    mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);  // The mapping stays valid without the descriptor
+
+    if (mapping == MAP_FAILED) {
+        std::cout << RED << "[PCM ERROR]" << CLEAR << " Unable to map " << path << " into memory." << std::endl;
+        return false;
+    }
+
+    // The file is read front to back exactly once
+    madvise(mapping, mapping_size, MADV_SEQUENTIAL);
+
+    const uint8_t* file = (const uint8_t*)mapping;
+
+    if (mapping_size >= 12 && std::memcmp(file, "RIFF", 4) == 0 && std::memcmp(file + 8, "WAVE", 4) == 0) {
+        if (!parse_wav(file, mapping_size)) {
+            std::cout << RED << "[PCM ERROR]" << CLEAR << " " << path << " is not a 16-bit PCM WAV file." << std::endl;
+            close();
+            return false;
+        }
+    } else {
+        channel_count = raw_channels;
+        rate          = raw_sample_rate;
+        data          = (const short*)file;
+        count         = mapping_size / (sizeof(short) * channel_count);
+    }
+
+    std::cout << GREEN << "[PCM INFO]" << CLEAR << " Mapped " << path << ": " << count << " frames, "
+              << channel_count << " channels, " << rate << " Hz." << std::endl;
+
+    return true;
+}
+
+
+bool PCMFile::parse_wav(const uint8_t* file, size_t size) {
+    bool format_found = false;
+    size_t position = 12;
+
+    // Walk the RIFF chunks, the "fmt " chunk has to come before "data"
+    while (position + 8 <= size) {
+        const uint8_t* chunk = file + position;
+        uint32_t chunk_size = read_u32(chunk + 4);
+
+        if (std::memcmp(chunk, "fmt ", 4) == 0) {
+            // A format that runs past the end of the file is as broken as one that is too short
+            if (chunk_size < 16 || chunk_size > size - position - 8) {
+                return false;
+            }
+
+            uint16_t audio_format    = read_u16(chunk + 8);
+            uint16_t bits_per_sample = read_u16(chunk + 22);
+
+            // 0xFFFE is WAVE_FORMAT_EXTENSIBLE, used by many tools for plain PCM too
+            if ((audio_format != 1 && audio_format != 0xFFFE) || bits_per_sample != 16) {
+                return false;
+            }
+
+            channel_count = read_u16(chunk + 10);
+            rate          = read_u32(chunk + 12);
+
+            // Everything downstream divides by both
+            if (channel_count == 0 || rate == 0) {
+                return false;
+            }
+
+            format_found = true;
+
+        } else if (std::memcmp(chunk, "data", 4) == 0 && format_found) {
+            size_t data_size = std::min<size_t>(chunk_size, size - position - 8);
+            data  = (const short*)(chunk + 8);
+            count = data_size / (sizeof(short) * channel_count);
+            return true;
+        }
+
+        // Chunks are padded to an even size
+        position += 8 + chunk_size + (chunk_size & 1);
+    }
+
+    return false;
+}
+
+
+void PCMFile::close() {
+    if (mapping != MAP_FAILED) {
+        munmap(mapping, mapping_size);
+    }
+
+    mapping       = MAP_FAILED;
+    mapping_size  = 0;
+    data          = nullptr;
+    count         = 0;
+    channel_count = 0;
+    rate          = 0;
+}
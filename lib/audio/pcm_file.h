@@ -0,0 +1,42 @@
+#ifndef _PCM_FILE_H_
+#define _PCM_FILE_H_
+
+
+#include "../main.h"
+
+
+// Read-only memory mapping of a 16-bit PCM WAV file or a headerless raw PCM file. The frames
+// are read straight from the page cache, nothing is copied.
+class PCMFile {
+
+public:
+    PCMFile() = default;
+    ~PCMFile();
+
+    PCMFile(const PCMFile&) = delete;
+    PCMFile& operator=(const PCMFile&) = delete;
+
+    // Raw files have no header, so their format is taken from the given defaults
+    bool open(const std::string& path, unsigned int raw_channels, unsigned int raw_sample_rate);
+    void close();
+
+    const short* frames()      const { return data; }
+    size_t       frame_count() const { return count; }
+    unsigned int channels()    const { return channel_count; }
+    unsigned int sample_rate() const { return rate; }
+
+
+private:
+    void*        mapping       = MAP_FAILED;
+    size_t       mapping_size  = 0;
+    const short* data          = nullptr;
+    size_t       count         = 0;
+    unsigned int channel_count = 0;
+    unsigned int rate          = 0;
+
+    bool parse_wav(const uint8_t* file, size_t size);
+
+};
+
+
+#endif
@@ -0,0 +1,238 @@
+#ifndef _RING_BUFFER_H_
+#define _RING_BUFFER_H_
+
+
+#include "../main.h"
+#include <atomic>
+
+
+// Lock-free single-producer/single-consumer ring buffer for interleaved PCM frames.
+//
+// The producer (audio thread) never waits: if the consumer falls behind, the oldest frames
+// are overwritten and counted as an overrun. The consumer can either read the latest N frames
+// or pop frames in order. Reads are validated after copying, so a copy that raced with the
+// producer is detected and retried instead of returning torn data.
+class PCMRingBuffer {
+
+public:
+    // Read-only view of frames inside the ring. The frames may wrap around the end of the
+    // buffer, so a view consists of up to two segments.
+    struct View {
+        const short* first         = nullptr;
+        size_t       first_frames  = 0;
+        const short* second        = nullptr;
+        size_t       second_frames = 0;
+        uint64_t     position      = 0;
+    };
+
+    PCMRingBuffer(unsigned int channels, size_t capacity_frames) {
+        reset(channels, capacity_frames);
+    }
+
+    // Not thread safe, only call this while neither side is running
+    void reset(unsigned int channels, size_t capacity_frames) {
+        size_t capacity = 1;
+        while (capacity < capacity_frames) capacity <<= 1;
+
+        this->channels = channels;
+        this->capacity = capacity;
+        mask = capacity - 1;
+        data.assign(capacity * channels, 0);
+
+        write_position.store(0, std::memory_order_relaxed);
+        claim_position.store(0, std::memory_order_relaxed);
+        read_position.store(0, std::memory_order_relaxed);
+        overrun_count.store(0, std::memory_order_relaxed);
+        dropped_frame_count.store(0, std::memory_order_relaxed);
+    }
+
+    // Producer side
+    void push(const short* frames, size_t count) {
+        uint64_t write = write_position.load(std::memory_order_relaxed);
+        uint64_t read  = read_position.load(std::memory_order_acquire);
+
+        if (write + count - read > capacity) {
+            overrun_count.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Only the newest frames fit if the write is larger than the whole buffer
+        if (count > capacity) {
+            frames += (count - capacity) * channels;
+            write  += count - capacity;
+            count   = capacity;
+        }
+
+        // Announce the frames about to be overwritten before touching them, so that a reader
+        // copying concurrently can tell its data was torn
+        claim_position.store(write + count, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        size_t start = write & mask;
+        size_t first = std::min(count, capacity - start);
+
+        std::memcpy(&data[start * channels], frames, first * channels * sizeof(short));
+        std::memcpy(&data[0], frames + first * channels, (count - first) * channels * sizeof(short));
+
+        write_position.store(write + count, std::memory_order_release);
+    }
+
+    // Consumer side. Copies the newest `count` frames into destination. Returns false if fewer
+    // than `count` frames have been captured so far or if the producer kept overwriting the data.
+    bool read_latest(short* destination, size_t count) {
+        if (count > capacity) return false;
+
+        for (int attempt = 0; attempt < 3; attempt++) {
+            uint64_t write = write_position.load(std::memory_order_acquire);
+            if (write < count) return false;
+
+            uint64_t start = write - count;
+            copy_out(start, destination, count);
+
+            if (still_valid(start)) {
+                mark_read(start, write);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    // Consumer side. Points the view at the newest `count` frames without copying them. The
+    // producer may overwrite the frames while they are being read, so check is_valid() after
+    // reading and discard the results if it returns false.
+    bool latest_view(View& view, size_t count) {
+        uint64_t write = write_position.load(std::memory_order_acquire);
+        if (count > capacity || write < count) return false;
+
+        uint64_t start = write - count;
+        size_t index = start & mask;
+
+        view.position      = start;
+        view.first         = &data[index * channels];
+        view.first_frames  = std::min(count, capacity - index);
+        view.second        = &data[0];
+        view.second_frames = count - view.first_frames;
+
+        mark_read(start, write);
+        return true;
+    }
+
+    bool is_valid(const View& view) const {
+        return still_valid(view.position);
+    }
+
+    // Consumer side. Points the view at the oldest `count` unread frames without copying or
+    // consuming them. Returns false if fewer than `count` frames are waiting.
+    bool peek(View& view, size_t count) {
+        uint64_t read  = read_position.load(std::memory_order_relaxed);
+        uint64_t write = write_position.load(std::memory_order_acquire);
+
+        // Skip frames that have already been overwritten
+        if (write - read > capacity) {
+            dropped_frame_count.fetch_add(write - read - capacity, std::memory_order_relaxed);
+            read = write - capacity;
+            read_position.store(read, std::memory_order_release);
+        }
+
+        if (count > capacity || write - read < count) return false;
+
+        size_t index = read & mask;
+
+        view.position      = read;
+        view.first         = &data[index * channels];
+        view.first_frames  = std::min(count, capacity - index);
+        view.second        = &data[0];
+        view.second_frames = count - view.first_frames;
+
+        return true;
+    }
+
+    // Consumer side. Marks the frames of a peeked view as read. Returns false if the producer
+    // overwrote them while they were being read, in which case the data must be discarded.
+    bool consume(const View& view) {
+        if (!still_valid(view.position)) {
+            uint64_t write = write_position.load(std::memory_order_acquire);
+            dropped_frame_count.fetch_add(write - view.position, std::memory_order_relaxed);
+            read_position.store(write, std::memory_order_release);
+            return false;
+        }
+
+        read_position.store(view.position + view.first_frames + view.second_frames, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Copies up to `count` unread frames in order and returns how many were copied.
+    size_t pop(short* destination, size_t count) {
+        uint64_t read  = read_position.load(std::memory_order_relaxed);
+        uint64_t write = write_position.load(std::memory_order_acquire);
+
+        // Skip frames that have already been overwritten
+        if (write - read > capacity) {
+            dropped_frame_count.fetch_add(write - read - capacity, std::memory_order_relaxed);
+            read = write - capacity;
+        }
+
+        count = std::min<uint64_t>(count, write - read);
+        copy_out(read, destination, count);
+
+        if (!still_valid(read)) {
+            // Lost the race against the producer; resynchronize on the next call
+            dropped_frame_count.fetch_add(count, std::memory_order_relaxed);
+            read_position.store(write_position.load(std::memory_order_acquire), std::memory_order_release);
+            return 0;
+        }
+
+        read_position.store(read + count, std::memory_order_release);
+        return count;
+    }
+
+    size_t available() const {
+        return write_position.load(std::memory_order_acquire) - read_position.load(std::memory_order_relaxed);
+    }
+
+    unsigned int get_channels() const { return channels; }
+    size_t       get_capacity() const { return capacity; }
+    uint64_t     overruns()       const { return overrun_count.load(std::memory_order_relaxed); }
+    uint64_t     dropped_frames() const { return dropped_frame_count.load(std::memory_order_relaxed); }
+
+
+private:
+    std::vector<short> data;
+    unsigned int channels = 0;
+    size_t capacity = 0;
+    size_t mask = 0;
+
+    // Positions are frame counters that only ever grow, the buffer index is position & mask
+    alignas(64) std::atomic<uint64_t> write_position{0};
+    std::atomic<uint64_t> claim_position{0};
+    alignas(64) std::atomic<uint64_t> read_position{0};
+
+    alignas(64) std::atomic<uint64_t> overrun_count{0};
+    std::atomic<uint64_t> dropped_frame_count{0};
+
+    void copy_out(uint64_t position, short* destination, size_t count) const {
+        size_t start = position & mask;
+        size_t first = std::min(count, capacity - start);
+
+        std::memcpy(destination, &data[start * channels], first * channels * sizeof(short));
+        std::memcpy(destination + first * channels, &data[0], (count - first) * channels * sizeof(short));
+    }
+
+    void mark_read(uint64_t start, uint64_t write) {
+        uint64_t read = read_position.load(std::memory_order_relaxed);
+        if (start > read) {
+            dropped_frame_count.fetch_add(start - read, std::memory_order_relaxed);
+        }
+        read_position.store(write, std::memory_order_release);
+    }
+
+    // The copied frames are intact if the producer has not started wrapping around onto them
+    bool still_valid(uint64_t position) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return claim_position.load(std::memory_order_relaxed) - position <= capacity;
+    }
+
+};
+
+
+#endif
@@ -0,0 +1,167 @@
+#include "spectrum_publisher.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <signal.h>
+#include <cerrno>
+
+
+static std::string segment_name;
+static void*       segment      = nullptr;
+static size_t      segment_size = 0;
+
+
+// Whether an existing segment can be replaced: it was closed, its owner no longer runs, or it
+// isn't a spectrum segment in a layout this build knows at all. owner is set to the running
+// publisher otherwise.
+static bool segment_is_stale(const std::string& name, pid_t& owner) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) return errno == ENOENT;
+
+    struct stat info;
+    bool stale = true;
+
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(SpectrumShmHeader)) {
+        void* mapping = mmap(nullptr, sizeof(SpectrumShmHeader), PROT_READ, MAP_SHARED, fd, 0);
+
+        if (mapping != MAP_FAILED) {
+            const SpectrumShmHeader* header = (const SpectrumShmHeader*)mapping;
+
+            if (header->magic == SPECTRUM_SHM_MAGIC && header->version == SPECTRUM_SHM_VERSION &&
+                header->state.load(std::memory_order_acquire) != SpectrumShmState::Closed) {
+                owner = header->owner_pid;
+
+                // EPERM means the process exists, it just belongs to another user
+                stale = owner <= 0 || (kill(owner, 0) < 0 && errno == ESRCH);
+            }
+
+            munmap(mapping, sizeof(SpectrumShmHeader));
+        }
+    }
+
+    close(fd);
+    return stale;
+}
+
+
+bool spectrum_publisher::init(const std::string& name, const std::vector<std::string>& devices, int band_count, unsigned int sample_rate, int hop_size) {
+    uint32_t source_count = devices.size();
+    size_t size = spectrum_shm_size(source_count, band_count, SPECTRUM_SHM_SLOTS);
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+
+    // A segment left behind by a crashed run is replaced, one that is in use is left alone
+    if (fd < 0 && errno == EEXIST) {
+        pid_t owner = 0;
+
+        if (!segment_is_stale(name, owner)) {
+            std::cout << RED << "[SHM ERROR]" << CLEAR << " Shared memory " << name << " is in use by process " << owner
+                      << ", choose another --shm name." << std::endl;
+            return false;
+        }
+
+        std::cout << YELLOW << "[SHM WARN]" << CLEAR << " Replacing the stale shared memory " << name << "." << std::endl;
+        shm_unlink(name.c_str());
+        fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    }
+
+    if (fd < 0) {
+        std::cout << RED << "[SHM ERROR]" << CLEAR << " Unable to create shared memory " << name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    if (ftruncate(fd, size) < 0) {
+        std::cout << RED << "[SHM ERROR]" << CLEAR << " Unable to resize shared memory " << name << ": " << strerror(errno) << std::endl;
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        std::cout << RED << "[SHM ERROR]" << CLEAR << " Unable to map shared memory " << name << ": " << strerror(errno) << std::endl;
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    // ftruncate() zeroed the segment, so every slot starts with sequence 0, i.e. empty
+    SpectrumShmHeader* header = new (mapping) SpectrumShmHeader();
+    header->magic        = SPECTRUM_SHM_MAGIC;
+    header->version      = SPECTRUM_SHM_VERSION;
+    header->owner_pid    = getpid();
+    header->source_count = source_count;
+    header->band_count   = band_count;
+    header->slot_count   = SPECTRUM_SHM_SLOTS;
+    header->hop_size     = hop_size;
+    header->slot_stride  = spectrum_shm_slot_stride(band_count);
+    header->size         = size;
+
+    SpectrumShmSource* sources = spectrum_shm_sources(mapping);
+    for (uint32_t i = 0; i < source_count; i++) {
+        new (&sources[i]) SpectrumShmSource();
+        sources[i].published.store(0, std::memory_order_relaxed);
+        sources[i].sample_rate.store(sample_rate, std::memory_order_relaxed);
+        std::strncpy(sources[i].device, devices[i].c_str(), SPECTRUM_SHM_DEVICE_LENGTH - 1);
+    }
+
+    // Readers only look at the rest once the segment is live
+    header->state.store(SpectrumShmState::Live, std::memory_order_release);
+
+    segment_name = name;
+    segment      = mapping;
+    segment_size = size;
+
+    std::cout << GREEN << "[SHM INFO]" << CLEAR << " Publishing spectra of " << source_count << " source(s) in shared memory "
+              << name << " (" << size / 1024 << " KiB)." << std::endl;
+
+    return true;
+}
+
+
+void spectrum_publisher::shutdown() {
+    if (!segment) return;
+
+    ((SpectrumShmHeader*)segment)->state.store(SpectrumShmState::Closed, std::memory_order_release);
+
+    // Readers keep their mappings, the memory is freed once the last one unmaps it
+    munmap(segment, segment_size);
+    shm_unlink(segment_name.c_str());
+
+    segment = nullptr;
+}
+
+
+bool spectrum_publisher::active() {
+    return segment != nullptr;
+}
+
+
+void spectrum_publisher::set_sample_rate(uint32_t source, unsigned int sample_rate) {
+    if (!segment || source >= ((const SpectrumShmHeader*)segment)->source_count) return;
+
+    spectrum_shm_sources(segment)[source].sample_rate.store(sample_rate, std::memory_order_release);
+}
+
+
+void spectrum_publisher::publish(uint32_t source, uint64_t capture_time_ns, const double* bands) {
+    if (!segment) return;
+
+    const SpectrumShmHeader* header = (const SpectrumShmHeader*)segment;
+    if (source >= header->source_count) return;
+
+    SpectrumShmSource& state = spectrum_shm_sources(segment)[source];
+    uint64_t frame = state.published.load(std::memory_order_relaxed) + 1;
+
+    SpectrumShmFrame* slot = spectrum_shm_slot(segment, source, (frame - 1) % header->slot_count);
+
+    // Odd while writing. The fence keeps the writes below from becoming visible before it.
+    slot->sequence.store(2 * frame - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot->capture_time_ns = capture_time_ns;
+    std::memcpy(slot->bands(), bands, header->band_count * sizeof(double));
+
+    slot->sequence.store(2 * frame, std::memory_order_release);
+    state.published.store(frame, std::memory_order_release);
+}
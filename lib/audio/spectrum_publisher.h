@@ -0,0 +1,35 @@
+#ifndef _SPECTRUM_PUBLISHER_H_
+#define _SPECTRUM_PUBLISHER_H_
+
+
+#include "../main.h"
+#include "spectrum_shm.h"
+
+
+// Publishes every spectrum of every capture source into a POSIX shared memory segment (see
+// spectrum_shm.h for the layout), so other local programs can follow the band intensities.
+//
+// Each source has a ring of SPECTRUM_SHM_SLOTS frames. A frame is written in place and guarded
+// by its own sequence number like a seqlock, so any number of readers can use the frames right
+// in the mapping, without copies, locks or system calls. Readers never slow the analysis down.
+namespace spectrum_publisher {
+
+    // Creates the segment, e.g. "/audio_visualizer". A segment of the same name is only replaced
+    // if it is stale, i.e. closed or left behind by a process that no longer runs. The devices
+    // are the capture sources in order, their sample rates start out as the requested one.
+    bool init(const std::string& name, const std::vector<std::string>& devices, int band_count, unsigned int sample_rate, int hop_size);
+
+    // The rate the source's device negotiated, which may differ from the requested one
+    void set_sample_rate(uint32_t source, unsigned int sample_rate);
+
+    // Marks the segment as closed and removes it
+    void shutdown();
+
+    bool active();
+
+    // Only one thread at a time may publish frames of the same source
+    void publish(uint32_t source, uint64_t capture_time_ns, const double* bands);
+}
+
+
+#endif
@@ -0,0 +1,109 @@
+#include "spectrum_reader.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+
+
+bool SpectrumReader::open(const std::string& name) {
+    close();
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) < 0 || (size_t)info.st_size < sizeof(SpectrumShmHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (mapping == MAP_FAILED) return false;
+
+    // The publisher fills in the header before it goes live, it may still be initializing
+    const SpectrumShmHeader* shared = (const SpectrumShmHeader*)mapping;
+    bool usable = shared->state.load(std::memory_order_acquire) != SpectrumShmState::Initializing &&
+                  shared->magic == SPECTRUM_SHM_MAGIC && shared->version == SPECTRUM_SHM_VERSION &&
+                  shared->size <= (uint64_t)info.st_size && shared->slot_count > 0;
+
+    if (!usable) {
+        munmap(mapping, info.st_size);
+        return false;
+    }
+
+    segment = mapping;
+    size    = info.st_size;
+
+    return true;
+}
+
+
+void SpectrumReader::close() {
+    if (!segment) return;
+
+    munmap(segment, size);
+    segment = nullptr;
+    size    = 0;
+}
+
+
+bool SpectrumReader::closed() const {
+    return header()->state.load(std::memory_order_acquire) == SpectrumShmState::Closed;
+}
+
+
+uint32_t SpectrumReader::sample_rate(uint32_t source) const {
+    return spectrum_shm_sources(segment)[source].sample_rate.load(std::memory_order_acquire);
+}
+
+
+uint64_t SpectrumReader::published(uint32_t source) const {
+    return spectrum_shm_sources(segment)[source].published.load(std::memory_order_acquire);
+}
+
+
+const SpectrumShmFrame* SpectrumReader::frame(uint32_t source, uint64_t frame) const {
+    if (frame == 0) return nullptr;
+
+    const SpectrumShmFrame* spectrum = spectrum_shm_slot(segment, source, (frame - 1) % slot_count());
+
+    // Any other value means the slot holds an older or newer frame, or is being written
+    if (spectrum->sequence.load(std::memory_order_acquire) != 2 * frame) return nullptr;
+
+    return spectrum;
+}
+
+
+const SpectrumShmFrame* SpectrumReader::latest(uint32_t source, uint64_t& frame) const {
+    frame = published(source);
+    return this->frame(source, frame);
+}
+
+
+const SpectrumShmFrame* SpectrumReader::next(uint32_t source, uint64_t& cursor, uint64_t* lost) const {
+    uint64_t newest = published(source);
+    if (newest <= cursor) return nullptr;
+
+    // Frames more than a ring behind were overwritten. One more is skipped as a margin, since
+    // the writer may already be filling the slot of the oldest one.
+    uint64_t oldest = newest > slot_count() ? newest - slot_count() + 2 : 1;
+    uint64_t wanted = std::max(cursor + 1, oldest);
+
+    const SpectrumShmFrame* spectrum = frame(source, wanted);
+    if (!spectrum) return nullptr;
+
+    if (lost) *lost += wanted - (cursor + 1);
+    cursor = wanted;
+
+    return spectrum;
+}
+
+
+bool SpectrumReader::valid(const SpectrumShmFrame* spectrum, uint64_t frame) const {
+    // Keeps the reads of the frame from moving past the check
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return spectrum->sequence.load(std::memory_order_relaxed) == 2 * frame;
+}
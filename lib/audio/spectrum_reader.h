@@ -0,0 +1,80 @@
+#ifndef _SPECTRUM_READER_H_
+#define _SPECTRUM_READER_H_
+
+
+// Reads the spectra the visualizer publishes in shared memory (--shm). Meant to be compiled into
+// other programs together with spectrum_reader.cpp, it only needs the standard library and
+// POSIX shared memory (link with -lrt on older glibc versions).
+//
+//     SpectrumReader reader;
+//     reader.open("/audio_visualizer");
+//
+//     uint64_t frame;
+//     if (const SpectrumShmFrame* spectrum = reader.latest(0, frame)) {
+//         double bass = spectrum->bands()[0];
+//         if (reader.valid(spectrum, frame)) use(bass);
+//     }
+//
+// Frames are read in place. The visualizer may overwrite a slot while it is read, once the
+// source has published SPECTRUM_SHM_SLOTS newer frames, so whatever was read is only good if
+// valid() still returns true afterwards. None of the calls except open() and close() make
+// system calls or take locks.
+
+#include "spectrum_shm.h"
+#include <string>
+
+
+class SpectrumReader {
+
+public:
+    ~SpectrumReader() { close(); }
+
+    // Maps the segment. Fails if it doesn't exist (yet) or has an unknown layout.
+    bool open(const std::string& name);
+    void close();
+
+    bool is_open() const { return segment != nullptr; }
+
+    // The visualizer exited, the frames stay readable but no new ones arrive. Reopen to pick
+    // up the next run.
+    bool closed() const;
+
+    uint32_t    source_count() const { return header()->source_count; }
+    uint32_t    band_count()   const { return header()->band_count; }
+    uint32_t    slot_count()   const { return header()->slot_count; }
+    uint32_t    hop_size()     const { return header()->hop_size; }
+    const char* device(uint32_t source) const { return spectrum_shm_sources(segment)[source].device; }
+
+    // The rate the source's device runs at, the bins of its spectra depend on it
+    uint32_t sample_rate(uint32_t source) const;
+
+    // Frames the source has published so far, the newest one is frame published()
+    uint64_t published(uint32_t source) const;
+
+    // Frame number `frame` of the source, or nullptr if it isn't in the ring (not published yet
+    // or already overwritten) or is being written right now
+    const SpectrumShmFrame* frame(uint32_t source, uint64_t frame) const;
+
+    // The newest complete frame and its number, nullptr if there is none yet
+    const SpectrumShmFrame* latest(uint32_t source, uint64_t& frame) const;
+
+    // The frame after `cursor`, for readers that want every frame in order, e.g. loggers. Start
+    // with cursor 0 for the oldest frame in the ring, or with published() for new frames only.
+    // Advances the cursor, skipping frames that were already overwritten and adding them to
+    // lost. nullptr if there is no newer frame yet (or it was overwritten just now, try again).
+    const SpectrumShmFrame* next(uint32_t source, uint64_t& cursor, uint64_t* lost = nullptr) const;
+
+    // Whether the frame wasn't overwritten since frame() returned it. Call this after reading it.
+    bool valid(const SpectrumShmFrame* spectrum, uint64_t frame) const;
+
+
+private:
+    void*  segment = nullptr;
+    size_t size    = 0;
+
+    const SpectrumShmHeader* header() const { return (const SpectrumShmHeader*)segment; }
+
+};
+
+
+#endif
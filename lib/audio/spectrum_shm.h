@@ -0,0 +1,91 @@
+#ifndef _SPECTRUM_SHM_H_
+#define _SPECTRUM_SHM_H_
+
+
+// Layout of the shared memory segment the spectra are published in, see spectrum_publisher.h
+// for the writer and spectrum_reader.h for the reader. Other programs include this header, so
+// it only depends on the standard library.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+
+#define SPECTRUM_SHM_MAGIC   0x53505543u  // "SPUC"
+#define SPECTRUM_SHM_VERSION 3
+
+// Frames kept per source. A reader that falls further behind than this misses frames.
+#define SPECTRUM_SHM_SLOTS 64
+
+#define SPECTRUM_SHM_DEVICE_LENGTH 64
+
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "The shared memory needs lock-free 64 bit atomics");
+
+
+enum class SpectrumShmState : uint32_t {
+    Initializing,
+    Live,
+    Closed  // The visualizer exited, nothing will be published anymore
+};
+
+
+// At the start of the segment. Everything except state is written once before state becomes Live.
+struct SpectrumShmHeader {
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<SpectrumShmState> state;
+    int32_t  owner_pid;    // The publishing process, a segment whose owner is gone is stale
+
+    uint32_t source_count;
+    uint32_t band_count;
+    uint32_t slot_count;
+    uint32_t hop_size;     // Samples between spectra at the source's sample rate
+    uint64_t slot_stride;  // Bytes from one slot to the next
+    uint64_t size;         // Of the whole segment
+};
+
+
+// Follows the header, one per source
+struct alignas(64) SpectrumShmSource {
+    std::atomic<uint64_t> published;  // Frames of this source so far, the newest one is frame `published`
+    std::atomic<uint32_t> sample_rate;  // The rate the device actually runs at, can change once capturing starts
+    char device[SPECTRUM_SHM_DEVICE_LENGTH];
+};
+
+
+// One frame, followed by band_count doubles. Frame n (counting from 1) of a source is stored in
+// slot (n - 1) % slot_count. Its sequence is 2n - 1 while the frame is written and 2n once it
+// is complete, so a reader can tell which frame a slot holds and whether it is consistent.
+struct alignas(64) SpectrumShmFrame {
+    std::atomic<uint64_t> sequence;
+    uint64_t capture_time_ns;  // CLOCK_MONOTONIC time the newest analyzed period arrived
+
+    const double* bands() const { return reinterpret_cast<const double*>(this + 1); }
+    double*       bands()       { return reinterpret_cast<double*>(this + 1); }
+};
+
+
+// The slots of all sources follow the source array, source after source
+inline size_t spectrum_shm_slot_stride(uint32_t band_count) {
+    size_t size = sizeof(SpectrumShmFrame) + band_count * sizeof(double);
+    return (size + 63) & ~size_t(63);
+}
+
+inline size_t spectrum_shm_size(uint32_t source_count, uint32_t band_count, uint32_t slot_count) {
+    size_t header = (sizeof(SpectrumShmHeader) + 63) & ~size_t(63);
+    return header + source_count * sizeof(SpectrumShmSource) + (size_t)source_count * slot_count * spectrum_shm_slot_stride(band_count);
+}
+
+inline SpectrumShmSource* spectrum_shm_sources(void* segment) {
+    return reinterpret_cast<SpectrumShmSource*>((char*)segment + ((sizeof(SpectrumShmHeader) + 63) & ~size_t(63)));
+}
+
+inline SpectrumShmFrame* spectrum_shm_slot(void* segment, uint32_t source, uint64_t slot) {
+    const SpectrumShmHeader* header = (const SpectrumShmHeader*)segment;
+    char* slots = (char*)(spectrum_shm_sources(segment) + header->source_count);
+    return reinterpret_cast<SpectrumShmFrame*>(slots + (source * header->slot_count + slot) * header->slot_stride);
+}
+
+
+#endif
@@ -0,0 +1,73 @@
+#include "stft.h"
+
+
+bool parse_window_type(const std::string& name, WindowType& window_type) {
+    if      (name == "hann")            window_type = WindowType::Hann;
+    else if (name == "blackman-harris") window_type = WindowType::BlackmanHarris;
+    else if (name == "rectangular")     window_type = WindowType::Rectangular;
+    else return false;
+
+    return true;
+}
+
+
+bool STFT::configure(int window_length, int hop_size, WindowType window_type) {
+    if (window_length == this->window_length && hop_size == this->hop_size && window_type == this->window_type) {
+        return true;  // Nothing changed
+    }
+
+    if (window_length <= 0 || hop_size <= 0 || hop_size > window_length) {
+        std::cout << RED << "[STFT ERROR]" << CLEAR << " Invalid window length " << window_length << " and hop size " << hop_size << "." << std::endl;
+        return false;
+    }
+
+    this->window_length = window_length;
+    this->hop_size      = hop_size;
+    this->window_type   = window_type;
+
+    history.assign(window_length + hop_size, 0);
+    window.resize(window_length);
+    write_index = 0;
+    staged = 0;
+
+    // Periodic windows, since consecutive frames overlap
+    double sum = 0.0;
+    std::vector<double> values(window_length);
+
+    for (int i = 0; i < window_length; i++) {
+        double phase = 2.0 * M_PI * i / window_length;
+
+        switch (window_type) {
+            case WindowType::Hann:
+                values[i] = 0.5 - 0.5 * cos(phase);
+                break;
+            case WindowType::BlackmanHarris:
+                values[i] = 0.35875 - 0.48829 * cos(phase) + 0.14128 * cos(2 * phase) - 0.01168 * cos(3 * phase);
+                break;
+            default:
+                values[i] = 1.0;
+                break;
+        }
+
+        sum += values[i];
+    }
+
+    // Compensate for the coherent gain of the window so the intensity levels don't depend on it
+    for (int i = 0; i < window_length; i++) {
+        window[i] = values[i] * window_length / sum;
+    }
+
+    return true;
+}
+
+
+void STFT::commit_hop() {
+    write_index = (write_index + staged) % history.size();
+    staged = 0;
+}
+
+
+void STFT::discard_hop() {
+    staged = 0;
+}
+
@@ -0,0 +1,96 @@
+#ifndef _STFT_H_
+#define _STFT_H_
+
+
+#include "../main.h"
+#include "fft_engine.h"
+#include "dsp_kernels.h"
+
+
+enum class WindowType {
+    Rectangular,
+    Hann,
+    BlackmanHarris
+};
+
+
+bool parse_window_type(const std::string& name, WindowType& window_type);
+
+
+// Streaming short-time Fourier transform front end. Samples arrive one hop at a time and are
+// kept in a circular history, so every hop yields a new, overlapping frame without recomputing
+// anything from scratch.
+//
+// The history holds one hop more than the window. A hop is first staged into that spare space
+// and only becomes part of the window once committed, so a hop that turns out to be invalid can
+// be discarded without losing any of the samples in the current window.
+class STFT {
+
+public:
+    bool configure(int window_length, int hop_size, WindowType window_type);
+
+    // Downmixes and pre-emphasizes interleaved frames straight into the staged hop. Channels
+    // can fix the channel count at compile time, see downmix_pre_emphasis().
+    template <int Channels = 0>
+    void stage(const short* frames, int count, int channels, fft_real alpha, fft_real& prev_sample) {
+        count = std::min(count, hop_size - staged);
+
+        int capacity = history.size();
+        int index = (write_index + staged) % capacity;
+        int first = std::min(count, capacity - index);
+
+        downmix_pre_emphasis<Channels>(frames, first, channels, alpha, prev_sample, &history[index]);
+        downmix_pre_emphasis<Channels>(frames + first * channels, count - first, channels, alpha, prev_sample, &history[0]);
+
+        staged += count;
+    }
+
+    // Stages samples that are already mono and pre-emphasized, e.g. decimated ones
+    void stage_samples(const fft_real* samples, int count) {
+        count = std::min(count, hop_size - staged);
+
+        int capacity = history.size();
+        int index = (write_index + staged) % capacity;
+        int first = std::min(count, capacity - index);
+
+        std::copy(samples, samples + first, &history[index]);
+        std::copy(samples + first, samples + count, &history[0]);
+
+        staged += count;
+    }
+
+    void commit_hop();
+    void discard_hop();
+
+    // Writes the windowed window_length() newest samples into frame, oldest first. WindowLength
+    // must either be 0 or match the configured window length.
+    template <int WindowLength = 0>
+    void windowed_frame(fft_real* frame) const {
+        const int length = WindowLength > 0 ? WindowLength : window_length;
+
+        int capacity = history.size();
+        int start = (write_index - length + capacity) % capacity;
+        int first = std::min(length, capacity - start);
+
+        apply_window(&history[start], &window[0], first, frame);
+        apply_window(&history[0], &window[first], length - first, frame + first);
+    }
+
+    int        get_window_length() const { return window_length; }
+    int        get_hop_size()      const { return hop_size; }
+    WindowType get_window_type()   const { return window_type; }
+
+
+private:
+    std::vector<fft_real> history;
+    std::vector<fft_real> window;
+    int window_length = 0;
+    int hop_size = 0;
+    int write_index = 0;  // End of the committed samples
+    int staged = 0;       // Samples staged after write_index
+    WindowType window_type = WindowType::Rectangular;
+
+};
+
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef _TRIPLE_BUFFER_H_
+#define _TRIPLE_BUFFER_H_
+
+
+#include "../main.h"
+#include <atomic>
+
+
+// Hands the newest value from one writer thread to one reader thread without locks or waiting.
+//
+// The writer fills its own slot and publishes it by swapping it with the middle slot. The
+// reader swaps its slot with the middle one whenever something new was published, so it always
+// gets the latest value and older ones the reader never picked up are simply overwritten.
+// Neither side ever waits for the other or touches the slot the other one is using.
+template <typename T>
+class TripleBuffer {
+
+public:
+    // Not thread safe, only call this while neither side is running
+    void reset(const T& value) {
+        for (T& slot : slots) slot = value;
+
+        back  = 0;
+        front = 1;
+        middle.store(2, std::memory_order_relaxed);
+    }
+
+    // Writer side. The slot stays the writer's until publish().
+    T& write_slot() {
+        return slots[back];
+    }
+
+    void publish() {
+        back = middle.exchange(back | NEW_VALUE, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Reader side. Switches to the newest published value, returns false if nothing was
+    // published since the last call.
+    bool update() {
+        if ((middle.load(std::memory_order_relaxed) & NEW_VALUE) == 0) return false;
+
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    // Stays unchanged until the next update()
+    const T& read_slot() const {
+        return slots[front];
+    }
+
+
+private:
+    static constexpr uint8_t INDEX_MASK = 3;
+    static constexpr uint8_t NEW_VALUE  = 4;
+
+    T slots[3];
+
+    // Each side's index on its own cache line
+    alignas(64) uint8_t back  = 0;
+    alignas(64) uint8_t front = 1;
+    alignas(64) std::atomic<uint8_t> middle{2};
+
+};
+
+
+#endif
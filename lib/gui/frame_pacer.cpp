@@ -0,0 +1,115 @@
+#include "frame_pacer.h"
+
+
+// Bounds of the spun part of the wait
+#define MIN_SPIN_MARGIN std::chrono::microseconds(500)
+#define MAX_SPIN_MARGIN std::chrono::microseconds(4000)
+
+
+static double to_ms(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+
+FramePacer::FramePacer(double fps, bool vsync) : history(FRAME_PACER_HISTORY, 0.f) {
+    set_rate(fps, vsync);
+}
+
+
+void FramePacer::set_rate(double fps, bool vsync) {
+    period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / fps));
+    this->vsync = vsync;
+    started = false;
+}
+
+
+double FramePacer::wait() {
+    // The first frame has nothing to be measured against
+    if (!started) {
+        started  = true;
+        previous = clock::now();
+        deadline = previous + period;
+        return to_ms(period);
+    }
+
+    if (!vsync) {
+        while (true) {
+            clock::time_point now = clock::now();
+            clock::duration remaining = deadline - now;
+            if (remaining <= spin_margin) break;
+
+            clock::duration sleep = remaining - spin_margin;
+            std::this_thread::sleep_for(sleep);
+
+            // Woke up past the deadline, spin for longer from now on
+            clock::duration overslept = clock::now() - (now + sleep);
+            if (overslept > spin_margin) {
+                spin_margin = std::min<clock::duration>(overslept + overslept / 4, MAX_SPIN_MARGIN);
+            }
+        }
+
+        while (clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+
+        // Give the margin back slowly while the sleeps are accurate
+        spin_margin = std::max<clock::duration>(spin_margin - std::chrono::microseconds(1), MIN_SPIN_MARGIN);
+    }
+
+    clock::time_point now = clock::now();
+    double frame_ms = to_ms(now - previous);
+    previous = now;
+
+    history[frames % history.size()] = frame_ms;
+    frames++;
+
+    // More than a whole period behind, start over from now instead of rushing to catch up
+    deadline += period;
+    if (now > deadline) {
+        missed++;
+        deadline = now + period;
+    }
+
+    return frame_ms;
+}
+
+
+FramePacer::Stats FramePacer::stats() const {
+    Stats result;
+    result.target_ms = to_ms(period);
+    result.frames    = frames;
+    result.missed    = missed;
+
+    size_t count = std::min<uint64_t>(frames, history.size());
+    if (count == 0) return result;
+
+    std::vector<float> recent(history.begin(), history.begin() + count);
+
+    double sum = 0, squares = 0;
+    for (float frame_ms : recent) {
+        sum     += frame_ms;
+        squares += (double)frame_ms * frame_ms;
+    }
+
+    result.mean_ms   = sum / count;
+    result.jitter_ms = std::sqrt(std::max(0.0, squares / count - result.mean_ms * result.mean_ms));
+
+    std::sort(recent.begin(), recent.end());
+    result.p99_ms = recent[std::min(count - 1, (size_t)(count * 0.99))];
+    result.max_ms = recent.back();
+
+    return result;
+}
+
+
+void FramePacer::print_stats() const {
+    Stats s = stats();
+    if (s.frames == 0) return;
+
+    char line[256];
+    snprintf(line, sizeof(line), "%.1f Hz target (%.3f ms%s): mean %.3f ms, jitter %.3f ms, p99 %.3f ms, max %.3f ms, %llu of %llu frames missed",
+        1000.0 / s.target_ms, s.target_ms, vsync ? ", vsync" : "", s.mean_ms, s.jitter_ms, s.p99_ms, s.max_ms,
+        (unsigned long long)s.missed, (unsigned long long)s.frames);
+
+    std::cout << GREEN << "[FP INFO]" << CLEAR << " " << line << std::endl;
+}
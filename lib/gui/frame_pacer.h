@@ -0,0 +1,60 @@
+#ifndef _FRAME_PACER_H_
+#define _FRAME_PACER_H_
+
+
+#include "../main.h"
+
+
+// Number of recent frame times kept for the jitter statistics
+#define FRAME_PACER_HISTORY 4096
+
+
+// Paces the render loop to absolute deadlines, so an early or late frame doesn't shift all
+// the following ones. Most of the wait is slept and the last stretch, which sleep_for can
+// overshoot by a scheduler quantum, is spun. The spin margin follows the largest oversleep
+// seen so far.
+//
+// With vsync the presentation itself blocks until the next refresh, so wait() only measures.
+class FramePacer {
+
+public:
+    FramePacer(double fps = 60, bool vsync = false);
+
+    void set_rate(double fps, bool vsync);
+
+    // Waits for the next deadline and returns the time since the previous call in milliseconds
+    double wait();
+
+    struct Stats {
+        double   target_ms = 0;
+        double   mean_ms   = 0;
+        double   jitter_ms = 0;  // Standard deviation of the frame times
+        double   p99_ms    = 0;
+        double   max_ms    = 0;
+        uint64_t frames    = 0;
+        uint64_t missed    = 0;  // Frames that ended more than one period late
+    };
+
+    // Over the last FRAME_PACER_HISTORY frames, except frames and missed which count everything
+    Stats stats() const;
+    void  print_stats() const;
+
+
+private:
+    typedef std::chrono::steady_clock clock;
+
+    clock::duration   period;
+    clock::time_point deadline;
+    clock::time_point previous;
+    clock::duration   spin_margin = std::chrono::microseconds(1000);
+    bool              vsync       = false;
+    bool              started     = false;
+
+    std::vector<float> history;
+    uint64_t           frames = 0;
+    uint64_t           missed = 0;
+
+};
+
+
+#endif
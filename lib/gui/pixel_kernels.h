@@ -0,0 +1,161 @@
+#ifndef _PIXEL_KERNELS_H_
+#define _PIXEL_KERNELS_H_
+
+
+#include "../main.h"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+// Pixels are 32-bit RGBA with the bytes in R, G, B, A order in memory (SDL_PIXELFORMAT_RGBA32).
+// On a little endian machine red is therefore the lowest byte of the uint32_t.
+inline uint32_t pack_rgba(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) {
+    return (uint32_t)r | (uint32_t)g << 8 | (uint32_t)b << 16 | (uint32_t)a << 24;
+}
+
+
+// Sets `count` pixels to the same value
+inline void fill_span(uint32_t* dst, int count, uint32_t pixel) {
+    int i = 0;
+
+#if defined(__AVX2__)
+    const __m256i pixels8 = _mm256_set1_epi32((int)pixel);
+    for (; i + 8 <= count; i += 8) {
+        _mm256_storeu_si256((__m256i*)(dst + i), pixels8);
+    }
+#endif
+
+#if defined(__SSE2__)
+    const __m128i pixels4 = _mm_set1_epi32((int)pixel);
+    for (; i + 4 <= count; i += 4) {
+        _mm_storeu_si128((__m128i*)(dst + i), pixels4);
+    }
+#endif
+
+    for (; i < count; i++) {
+        dst[i] = pixel;
+    }
+}
+
+
+// x / 255 for 0 <= x <= 255 * 255, rounded
+inline uint32_t divide_by_255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+
+// Blends `count` pixels with straight alpha over dst: rgb = src * a + dst * (1 - a) and
+// alpha = a + dst_alpha * (1 - a). Opaque pixels stay opaque.
+inline void blend_span(uint32_t* dst, const uint32_t* src, int count) {
+    int i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero    = _mm_setzero_si128();
+    const __m128i max     = _mm_set1_epi16(255);
+    const __m128i half    = _mm_set1_epi16(128);
+    const __m128i opaque  = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+
+        // Two pixels per register as 16-bit channels. The source alpha channel is replaced by
+        // 255, so that the alpha of the result comes out as a + dst_alpha * (1 - a).
+        __m128i s_lo = _mm_unpacklo_epi8(s, zero), s_hi = _mm_unpackhi_epi8(s, zero);
+        __m128i d_lo = _mm_unpacklo_epi8(d, zero), d_hi = _mm_unpackhi_epi8(d, zero);
+
+        // Alpha of each pixel copied to all four of its channels
+        __m128i a_lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        __m128i a_hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s_hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+
+        s_lo = _mm_or_si128(s_lo, opaque);
+        s_hi = _mm_or_si128(s_hi, opaque);
+
+        // src * a + dst * (255 - a) fits in 16 bits, then the same rounded division as divide_by_255()
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(s_lo, a_lo), _mm_mullo_epi16(d_lo, _mm_sub_epi16(max, a_lo))), half);
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(s_hi, a_hi), _mm_mullo_epi16(d_hi, _mm_sub_epi16(max, a_hi))), half);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#endif
+
+    for (; i < count; i++) {
+        uint32_t s = src[i], d = dst[i];
+        uint32_t a = s >> 24;
+
+        if (a == 0) continue;
+        if (a == 255) {
+            dst[i] = s;
+            continue;
+        }
+
+        uint32_t r = divide_by_255(( s        & 0xFF) * a + ( d        & 0xFF) * (255 - a));
+        uint32_t g = divide_by_255(((s >> 8)  & 0xFF) * a + ((d >> 8)  & 0xFF) * (255 - a));
+        uint32_t b = divide_by_255(((s >> 16) & 0xFF) * a + ((d >> 16) & 0xFF) * (255 - a));
+        uint32_t alpha = divide_by_255(255 * a + (d >> 24) * (255 - a));
+        dst[i] = pack_rgba(r, g, b, alpha);
+    }
+}
+
+
+// Drops the alpha channel: `count` RGBA pixels to packed 24-bit RGB
+inline void rgba_to_rgb24(const uint32_t* src, int count, uint8_t* dst) {
+    int i = 0;
+
+#if defined(__SSSE3__)
+    // Four pixels in, twelve bytes out. The store writes 16 bytes, so stop one group early.
+    const __m128i drop_alpha = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    for (; i + 8 <= count; i += 4) {
+        __m128i pixels = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + i)), drop_alpha);
+        _mm_storeu_si128((__m128i*)(dst + 3 * i), pixels);
+    }
+#endif
+
+    for (; i < count; i++) {
+        dst[3 * i]     = src[i]         & 0xFF;
+        dst[3 * i + 1] = (src[i] >> 8)  & 0xFF;
+        dst[3 * i + 2] = (src[i] >> 16) & 0xFF;
+    }
+}
+
+
+// RGBA to planar YUV 4:2:0 with BT.601 limited range coefficients, the layout of ffmpeg's
+// yuv420p. Width and height must be even. The chroma of every 2x2 block is the average of its
+// four pixels.
+inline void rgba_to_yuv420p(const uint32_t* src, int width, int height, uint8_t* y_plane, uint8_t* u_plane, uint8_t* v_plane) {
+    for (int y = 0; y < height; y += 2) {
+        const uint32_t* row0 = src + (size_t)y * width;
+        const uint32_t* row1 = row0 + width;
+        uint8_t* luma0 = y_plane + (size_t)y * width;
+        uint8_t* luma1 = luma0 + width;
+        uint8_t* u = u_plane + (size_t)(y / 2) * (width / 2);
+        uint8_t* v = v_plane + (size_t)(y / 2) * (width / 2);
+
+        for (int x = 0; x < width; x += 2) {
+            int r_sum = 0, g_sum = 0, b_sum = 0;
+
+            const uint32_t block[4] = {row0[x], row0[x + 1], row1[x], row1[x + 1]};
+            uint8_t* luma[4] = {&luma0[x], &luma0[x + 1], &luma1[x], &luma1[x + 1]};
+
+            for (int k = 0; k < 4; k++) {
+                int r = block[k] & 0xFF, g = (block[k] >> 8) & 0xFF, b = (block[k] >> 16) & 0xFF;
+                *luma[k] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+                r_sum += r;
+                g_sum += g;
+                b_sum += b;
+            }
+
+            int r = (r_sum + 2) >> 2, g = (g_sum + 2) >> 2, b = (b_sum + 2) >> 2;
+            u[x / 2] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            v[x / 2] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+}
+
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef _RENDER_BACKEND_H_
+#define _RENDER_BACKEND_H_
+
+
+#include "simple_graphics.h"
+#include <memory>
+
+
+// The drawing side of simple_graphics. The SDL backend renders into a window, the software
+// backend rasterizes on the CPU into an in-memory RGBA framebuffer and needs no window, video
+// driver or GPU at all.
+class RenderBackend {
+
+public:
+    virtual ~RenderBackend() = default;
+
+    virtual bool open(const char* title, uint16_t width, uint16_t height, uint32_t flags, bool vsync) = 0;
+    virtual void close() = 0;
+
+    // Shows the finished frame and collects the pressed keys into KEYS_PRESSED
+    virtual void present() = 0;
+
+    virtual void clear(RGBColor color) = 0;
+    virtual void fill_rect(Position2d position, Size2d size, RGBColor color) = 0;
+    virtual void draw_rect(Position2d position, Size2d size, RGBColor color) = 0;
+    virtual void draw_line(Position2d start, Position2d stop, RGBColor color) = 0;
+
+    // Rendered texts are converted once into a backend specific image that the text cache
+    // keeps. The surface is still owned by the caller.
+    virtual void* create_text_image(SDL_Surface* surface) = 0;
+    virtual void  destroy_text_image(void* image) = 0;
+    virtual void  draw_text_image(void* image, Position2d position, Size2d size) = 0;
+
+    virtual void batch_rect(Position2d position, Size2d size, RGBColor color) = 0;
+    virtual void flush_batch() = 0;
+
+    // Layers are transparent images of the display size. Between begin_layer_image() and
+    // end_layer_image() everything is drawn into the layer instead of the display. Returns
+    // nullptr if the backend can't render into images.
+    virtual void* create_layer_image() = 0;
+    virtual void  destroy_layer_image(void* image) = 0;
+    virtual void  begin_layer_image(void* image) = 0;
+    virtual void  end_layer_image() = 0;
+    virtual void  draw_layer_image(void* image) = 0;
+
+    // Whether the pixels of the last frame are still there after present(), so that only the
+    // damaged parts need to be cleared
+    virtual bool retains_frame() const { return false; }
+
+    // RGBA pixels of the current frame, see pixel_kernels.h. Only the software backend has one.
+    virtual const uint32_t* framebuffer() const { return nullptr; }
+
+};
+
+
+std::unique_ptr<RenderBackend> create_sdl_backend();
+std::unique_ptr<RenderBackend> create_software_backend();
+
+
+#endif
@@ -0,0 +1,213 @@
+#include "render_backend.h"
+#include <unordered_map>
+
+
+// Renders through an SDL_Renderer into a window
+class SDLBackend : public RenderBackend {
+
+public:
+    bool open(const char* title, uint16_t width, uint16_t height, uint32_t flags, bool vsync) override {
+        window = SDL_CreateWindow(
+                title,
+                SDL_WINDOWPOS_CENTERED_DISPLAY(0),
+                SDL_WINDOWPOS_CENTERED_DISPLAY(0),
+                width, height,
+                flags
+        );
+
+        if(!window) {
+            std::cout << RED << "[SG ERROR]" << CLEAR << " Window could not be created." << std::endl;
+            return false;
+        }
+
+        // With vsync SDL_RenderPresent() waits for the next refresh of the display
+        const uint32_t present_flags = vsync ? SDL_RENDERER_PRESENTVSYNC : 0;
+
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | present_flags);
+
+        // Headless video drivers (e.g. SDL_VIDEODRIVER=dummy) only provide the software renderer
+        if (!renderer) {
+            std::cout << YELLOW << "[SG WARN]" << CLEAR << " No accelerated renderer, falling back to software rendering." << std::endl;
+            renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE | present_flags);
+        }
+
+        if(!renderer) {
+            std::cout << RED << "[SG ERROR]" << CLEAR << " Could not create renderer." << std::endl;
+            return false;
+        }
+
+        this->width  = width;
+        this->height = height;
+
+        std::cout << GREEN << "[SG INFO]" << CLEAR << " SDL2 window created." << std::endl;
+
+        return true;
+    }
+
+    void close() override {
+        if (renderer) SDL_DestroyRenderer(renderer);
+        if (window)   SDL_DestroyWindow(window);
+        renderer = nullptr;
+        window   = nullptr;
+    }
+
+    void present() override {
+        if (window == nullptr || renderer == nullptr) {
+            std::cout << RED << "[SG ERROR]" << CLEAR << " Cannot update nonexistent window and/or renderer." << std::endl;
+            PROCESS_INTERRUPTED = true;
+            return;
+        }
+
+        SDL_Event event;
+        while (SDL_PollEvent(&event)) {
+            if(event.type == SDL_QUIT) {
+                PROCESS_INTERRUPTED = true;
+            }
+
+            if (event.type == SDL_KEYDOWN && event.key.repeat == 0) {
+                SDL_Keycode key_pressed = event.key.keysym.sym;
+                simple_graphics::KEYS_PRESSED.push_back(key_pressed);
+            }
+        }
+
+        SDL_RenderPresent(renderer);
+    }
+
+    // Opaque colors, so that shapes drawn into a layer aren't transparent
+    void clear(RGBColor color) override {
+        SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 255);
+        SDL_RenderClear(renderer);
+    }
+
+    void fill_rect(Position2d position, Size2d size, RGBColor color) override {
+        SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 255);
+        SDL_Rect rect = {position.x, position.y, size.width, size.height};
+        SDL_RenderFillRect(renderer, &rect);
+    }
+
+    void draw_rect(Position2d position, Size2d size, RGBColor color) override {
+        SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 255);
+        SDL_Rect rect = {position.x, position.y, size.width, size.height};
+        SDL_RenderDrawRect(renderer, &rect);
+    }
+
+    void draw_line(Position2d start, Position2d stop, RGBColor color) override {
+        SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 255);
+        SDL_RenderDrawLine(renderer, start.x, start.y, stop.x, stop.y);
+    }
+
+    void* create_text_image(SDL_Surface* surface) override {
+        return SDL_CreateTextureFromSurface(renderer, surface);
+    }
+
+    void destroy_text_image(void* image) override {
+        SDL_DestroyTexture((SDL_Texture*)image);
+    }
+
+    void draw_text_image(void* image, Position2d position, Size2d size) override {
+        SDL_Rect render_quad = {position.x, position.y, size.width, size.height};
+        SDL_RenderCopy(renderer, (SDL_Texture*)image, nullptr, &render_quad);
+    }
+
+    void batch_rect(Position2d position, Size2d size, RGBColor color) override {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        const float left   = position.x;
+        const float top    = position.y;
+        const float right  = position.x + size.width;
+        const float bottom = position.y + size.height;
+        const SDL_Color vertex_color = {color.r, color.g, color.b, 255};
+
+        batch_vertices.push_back(SDL_Vertex{{left,  top},    vertex_color, {0, 0}});
+        batch_vertices.push_back(SDL_Vertex{{right, top},    vertex_color, {0, 0}});
+        batch_vertices.push_back(SDL_Vertex{{left,  bottom}, vertex_color, {0, 0}});
+        batch_vertices.push_back(SDL_Vertex{{right, bottom}, vertex_color, {0, 0}});
+#else
+        uint32_t key = (uint32_t)color.r << 16 | (uint32_t)color.g << 8 | color.b;
+        batch_rects[key].push_back(SDL_Rect{position.x, position.y, size.width, size.height});
+        batch_rect_count++;
+#endif
+    }
+
+    void flush_batch() override {
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+        if (batch_vertices.empty()) return;
+
+        // Every quad uses the same index pattern, so the index array only grows when the batch
+        // is larger than ever before
+        const size_t quads = batch_vertices.size() / 4;
+        for (size_t quad = batch_indices.size() / 6; quad < quads; quad++) {
+            int first = (int)quad * 4;
+            batch_indices.insert(batch_indices.end(), {first, first + 1, first + 2, first + 2, first + 1, first + 3});
+        }
+
+        SDL_RenderGeometry(renderer, nullptr, batch_vertices.data(), (int)batch_vertices.size(), batch_indices.data(), (int)quads * 6);
+        batch_vertices.clear();
+#else
+        if (batch_rect_count == 0) return;
+
+        // Rectangles of different colors that overlap may be drawn in a different order here
+        for (auto& [key, rects] : batch_rects) {
+            if (rects.empty()) continue;
+
+            SDL_SetRenderDrawColor(renderer, key >> 16, (key >> 8) & 0xFF, key & 0xFF, 255);
+            SDL_RenderFillRects(renderer, rects.data(), (int)rects.size());
+            rects.clear();
+        }
+
+        batch_rect_count = 0;
+#endif
+    }
+
+    // Render target textures, composited with alpha blending
+    void* create_layer_image() override {
+        if (!SDL_RenderTargetSupported(renderer)) return nullptr;
+
+        SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_TARGET, width, height);
+        if (texture != nullptr) {
+            SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+        }
+
+        return texture;
+    }
+
+    void destroy_layer_image(void* image) override {
+        SDL_DestroyTexture((SDL_Texture*)image);
+    }
+
+    void begin_layer_image(void* image) override {
+        SDL_SetRenderTarget(renderer, (SDL_Texture*)image);
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+        SDL_RenderClear(renderer);
+    }
+
+    void end_layer_image() override {
+        SDL_SetRenderTarget(renderer, nullptr);
+    }
+
+    void draw_layer_image(void* image) override {
+        SDL_RenderCopy(renderer, (SDL_Texture*)image, nullptr, nullptr);
+    }
+
+
+private:
+    SDL_Window   *window   = nullptr;
+    SDL_Renderer *renderer = nullptr;
+    int           width    = 0;
+    int           height   = 0;
+
+    // Filled rectangles waiting to be submitted. With SDL_RenderGeometry every rectangle is two
+    // triangles in one vertex array, older SDL versions get one SDL_RenderFillRects per color.
+#if SDL_VERSION_ATLEAST(2, 0, 18)
+    std::vector<SDL_Vertex> batch_vertices;
+    std::vector<int>        batch_indices;
+#else
+    std::unordered_map<uint32_t, std::vector<SDL_Rect>> batch_rects;
+    size_t batch_rect_count = 0;
+#endif
+
+};
+
+
+std::unique_ptr<RenderBackend> create_sdl_backend() {
+    return std::make_unique<SDLBackend>();
+}
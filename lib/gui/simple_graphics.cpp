@@ -1,200 +1,473 @@
-#include "simple_graphics.h"
-
-
-namespace simple_graphics {
-
-
-SDL_Window   *window       = nullptr;
-SDL_Renderer *renderer     = nullptr;
-SDL_Texture  *text_texture = nullptr;
-TTF_Font     *font24       = nullptr;
-TTF_Font     *font16       = nullptr;
-
-std::vector<SDL_Keycode> KEYS_PRESSED;
-
-uint16_t window_width = 0;
-uint16_t window_height = 0;
-
-
-// --- WINDOW HANDLING ---
-
-bool init() {
-    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-        std::cout << RED << "[SG ERROR]" << CLEAR << " SDL could not be initialized." << std::endl;
-        return false;
-    }
-
-    if (TTF_Init() == -1) {
-        std::cout << RED << "[SG ERROR]" << CLEAR << " SDL_ttf could not be initialized." << std::endl;
-        return false;
-    }
-
-    font24 = TTF_OpenFont("lib/gui/fonts/fira_code.ttf", 24);
-    if (font24 == nullptr) {
-        std::cout << RED << "[SG ERROR]" << CLEAR << " Could not load default font 24." << std::endl;
-        return false;
-    }
-
-    font16 = TTF_OpenFont("lib/gui/fonts/fira_code.ttf", 16);
-    if (font16 == nullptr) {
-        std::cout << RED << "[SG ERROR]" << CLEAR << " Could not load default font 16." << std::endl;
-        return false;
-    }
-
-    std::cout << GREEN << "[SG INFO]" << CLEAR << " SDL2 initialized." << std::endl;
-
-    return true;
-}
-
-
-bool create_display(const char* title, uint16_t width, uint16_t height, uint32_t flags) {
-    window_width  = width;
-    window_height = height;
-
-    window = SDL_CreateWindow(
-            title,
-            SDL_WINDOWPOS_CENTERED_DISPLAY(0),
-            SDL_WINDOWPOS_CENTERED_DISPLAY(0),
-            // SDL_WINDOWPOS_CENTERED_DISPLAY(0),
-            // SDL_WINDOWPOS_CENTERED_DISPLAY(0),
-            window_width, window_height,
-            flags
-    );
-
-    if(!window) {
-        std::cout << RED << "[SG ERROR]" << CLEAR << " Window could not be created." << std::endl;
-        return false;
-    }
-
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-
-    if(!renderer) {
-        std::cout << RED << "[SG ERROR]" << CLEAR << " Could not create renderer." << std::endl;
-        return false;
-    }
-
-    std::cout << GREEN << "[SG INFO]" << CLEAR << " SDL2 window created." << std::endl;
-
-    return true;
-}
-
-
-double limit_fps(uint fps) {
-    std::chrono::milliseconds target_fps(1000 / fps);
-    static auto previous_frame_time = std::chrono::high_resolution_clock::now();
-    auto current_frame_time         = std::chrono::high_resolution_clock::now();
-
-    std::chrono::duration<double, std::milli> frame_duration = current_frame_time - previous_frame_time;
-
-    auto time_to_sleep = target_fps - frame_duration;
-
-    if (time_to_sleep.count() > 0)
-        std::this_thread::sleep_for(time_to_sleep);
-
-    previous_frame_time = std::chrono::high_resolution_clock::now();
-
-    std::chrono::duration<double, std::milli> full_frame_duration = previous_frame_time - current_frame_time + frame_duration;
-    return full_frame_duration.count();
-}
-
-
-void update_display() {
-    if (window == nullptr || renderer == nullptr) {
-        std::cout << RED << "[SG ERROR]" << CLEAR << " Cannot update nonexistent window and/or renderer." << std::endl;
-        PROCESS_INTERRUPTED = true;
-        return;
-    }
-
-    KEYS_PRESSED.clear();
-
-    SDL_Event event;
-    while (SDL_PollEvent(&event)) {
-        if(event.type == SDL_QUIT) {
-            PROCESS_INTERRUPTED = true;
-        }
-
-        if (event.type == SDL_KEYDOWN && event.key.repeat == 0) {
-            SDL_Keycode key_pressed = event.key.keysym.sym;
-            KEYS_PRESSED.push_back(key_pressed);
-        }
-    }
-
-    SDL_RenderPresent(renderer);
-}
-
-
-void close_display() {
-    SDL_DestroyRenderer(renderer);
-
-    TTF_CloseFont(font24);
-    TTF_CloseFont(font16);
-    SDL_DestroyTexture(text_texture);
-
-    SDL_DestroyWindow(window);
-
-    TTF_Quit();
-    SDL_Quit();
-
-    std::cout << YELLOW << "[SG WARN]" << CLEAR << " SDL2 window closed!" << std::endl;
-}
-
-
-
-// --- WINDOW GRAPHICS ---
-
-void fill_display(RGBColor color) {
-    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 0);
-    SDL_RenderClear(renderer);
-}
-
-
-void draw_rect(Position2d position, Size2d size, RGBColor color, bool filled) {
-    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 0);
-    
-    SDL_Rect rect;
-    rect.x = position.x;
-    rect.y = position.y;
-    rect.w = size.width;
-    rect.h = size.height;
-
-    if (filled)
-        SDL_RenderFillRect(renderer, &rect);
-    else
-        SDL_RenderDrawRect(renderer, &rect);
-}
-
-
-void draw_line(Position2d start, Position2d stop, RGBColor color) {
-    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, 0);
-    SDL_RenderDrawLine(renderer, start.x, start.y, stop.x, stop.y);
-}
-
-
-void draw_text(const char* text, Position2d position, TTF_Font *font, RGBColor color, bool aliasing) {
-    SDL_Surface* text_surface;
-
-    if (aliasing)
-        text_surface = TTF_RenderText_Blended(font, text, {color.r, color.g, color.b, 0});
-    else
-        text_surface = TTF_RenderText_Solid(font, text, {color.r, color.g, color.b, 0});
-
-    if (text_surface == nullptr) {
-        std::cout << RED << "[SG ERROR]" << CLEAR << " Unable to render text surface." << std::endl;
-        return;
-    }
-
-    text_texture = SDL_CreateTextureFromSurface(renderer, text_surface);
-    if (text_texture == nullptr) {
-        std::cout << RED << "[SG ERROR]" << CLEAR << " Unable to create texture from surface." << std::endl;
-        return;
-    };
-
-    // Free the text surface now that we have a texture
-    SDL_FreeSurface(text_surface);
-
-    SDL_Rect render_quad = { position.x, position.y, text_surface->w, text_surface->h };
-    SDL_RenderCopy(renderer, text_texture, nullptr, &render_quad);
-}
-
-
-} // namespace simple_graphics
+#include "simple_graphics.h"
+#include "render_backend.h"
+#include "frame_pacer.h"
+#include <list>
+#include <string_view>
+#include <unordered_map>
+
+
+namespace simple_graphics {
+
+
+static std::unique_ptr<RenderBackend> backend;
+
+TTF_Font     *font24       = nullptr;
+TTF_Font     *font16       = nullptr;
+
+std::vector<SDL_Keycode> KEYS_PRESSED;
+
+// Rendered text images, most recently used first
+struct TextCacheEntry {
+    size_t        hash;
+    std::string   text;
+    TTF_Font     *font;
+    RGBColor      color;
+    bool          aliasing;
+    void         *image;
+    int           width, height;
+};
+
+static std::list<TextCacheEntry> text_cache;
+static std::unordered_map<size_t, std::list<TextCacheEntry>::iterator> text_cache_index;
+
+uint16_t window_width = 0;
+uint16_t window_height = 0;
+
+// Static layers, the images are created lazily and belong to the backend
+struct Layer {
+    void *image = nullptr;
+    bool  valid = false;
+
+    std::vector<DamageRect> damage;  // What was drawn into the layer
+};
+
+static std::vector<Layer> layers;
+static int active_layer = -1;
+
+static void release_layers();
+
+// Bounds of what this frame and the previous frame drew. An overflow means everything.
+static std::vector<DamageRect> drawn;
+static std::vector<DamageRect> previous_drawn;
+static std::vector<DamageRect> presented_damage;
+static bool drawn_overflow    = false;
+static bool previous_overflow = true;
+static bool cleared_full      = false;
+
+static RGBColor background = {0, 0, 0};
+static bool     damage_overlay = false;
+
+static uint64_t damage_frames = 0;
+static uint64_t damage_pixels = 0;
+
+static void add_damage(Position2d position, Size2d size);
+static void reset_damage();
+
+
+// --- WINDOW HANDLING ---
+
+bool init(const char* renderer) {
+    if (std::string(renderer) == "software") {
+        // No video subsystem at all, SDL_ttf and the surface functions work without it
+        backend = create_software_backend();
+    } else if (std::string(renderer) == "sdl") {
+        if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+            std::cout << RED << "[SG ERROR]" << CLEAR << " SDL could not be initialized." << std::endl;
+            return false;
+        }
+        backend = create_sdl_backend();
+    } else {
+        std::cout << RED << "[SG ERROR]" << CLEAR << " Unknown renderer '" << renderer << "'." << std::endl;
+        return false;
+    }
+
+    if (TTF_Init() == -1) {
+        std::cout << RED << "[SG ERROR]" << CLEAR << " SDL_ttf could not be initialized." << std::endl;
+        return false;
+    }
+
+    font24 = TTF_OpenFont("lib/gui/fonts/fira_code.ttf", 24);
+    if (font24 == nullptr) {
+        std::cout << RED << "[SG ERROR]" << CLEAR << " Could not load default font 24." << std::endl;
+        return false;
+    }
+
+    font16 = TTF_OpenFont("lib/gui/fonts/fira_code.ttf", 16);
+    if (font16 == nullptr) {
+        std::cout << RED << "[SG ERROR]" << CLEAR << " Could not load default font 16." << std::endl;
+        return false;
+    }
+
+    std::cout << GREEN << "[SG INFO]" << CLEAR << " SDL2 initialized (" << renderer << " renderer)." << std::endl;
+
+    return true;
+}
+
+
+bool create_display(const char* title, uint16_t width, uint16_t height, uint32_t flags, bool vsync) {
+    window_width  = width;
+    window_height = height;
+
+    // The layers are redrawn at the new size and nothing is known about the new frame
+    release_layers();
+    reset_damage();
+
+    return backend != nullptr && backend->open(title, width, height, flags, vsync);
+}
+
+
+double limit_fps(uint fps) {
+    static FramePacer pacer(fps);
+    static uint pacer_fps = fps;
+
+    if (fps != pacer_fps) {
+        pacer.set_rate(fps, false);
+        pacer_fps = fps;
+    }
+
+    return pacer.wait();
+}
+
+
+void update_display() {
+    if (backend == nullptr) {
+        std::cout << RED << "[SG ERROR]" << CLEAR << " Cannot update nonexistent window and/or renderer." << std::endl;
+        PROCESS_INTERRUPTED = true;
+        return;
+    }
+
+    flush_batch();
+
+    if (damage_overlay) {
+        for (const DamageRect& rect : drawn) {
+            backend->draw_rect(rect.position, rect.size, RGBColor{255, 0, 255});
+        }
+    }
+
+    // Everything drawn now has to be cleared next frame, and everything drawn last frame was
+    // cleared in this one
+    presented_damage.clear();
+    if (cleared_full || drawn_overflow || previous_overflow) {
+        presented_damage.push_back(DamageRect{Position2d{0, 0}, Size2d{window_width, window_height}});
+    } else {
+        presented_damage.insert(presented_damage.end(), previous_drawn.begin(), previous_drawn.end());
+        presented_damage.insert(presented_damage.end(), drawn.begin(), drawn.end());
+    }
+
+    for (const DamageRect& rect : presented_damage) {
+        damage_pixels += (uint64_t)rect.size.width * rect.size.height;
+    }
+    damage_frames++;
+
+    previous_drawn.swap(drawn);
+    drawn.clear();
+    previous_overflow = drawn_overflow;
+    drawn_overflow    = false;
+    cleared_full      = false;
+
+    KEYS_PRESSED.clear();
+
+    backend->present();
+}
+
+
+void close_display() {
+    if (backend && backend->retains_frame() && damage_frames > 0) {
+        double redrawn = (double)damage_pixels / damage_frames / ((double)window_width * window_height);
+        std::cout << GREEN << "[SG INFO]" << CLEAR << " Damage tracking: " << std::min(redrawn, 1.0) * 100
+                  << "% of the frame changed on average." << std::endl;
+    }
+
+    damage_frames = 0;
+    damage_pixels = 0;
+
+    // The text and layer images belong to the backend
+    invalidate_text_cache();
+    release_layers();
+
+    if (backend) backend->close();
+    backend.reset();
+
+    TTF_CloseFont(font24);
+    TTF_CloseFont(font16);
+    font24 = nullptr;
+    font16 = nullptr;
+
+    TTF_Quit();
+    SDL_Quit();
+
+    std::cout << YELLOW << "[SG WARN]" << CLEAR << " SDL2 window closed!" << std::endl;
+}
+
+
+const uint32_t* framebuffer() {
+    return backend ? backend->framebuffer() : nullptr;
+}
+
+
+
+// --- WINDOW GRAPHICS ---
+
+void fill_display(RGBColor color) {
+    flush_batch();
+
+    bool same_background = color.r == background.r && color.g == background.g && color.b == background.b;
+
+    // Everything outside of what the previous frame drew is still background
+    if (active_layer < 0 && backend->retains_frame() && !previous_overflow && same_background) {
+        for (const DamageRect& rect : previous_drawn) {
+            backend->fill_rect(rect.position, rect.size, color);
+        }
+        return;
+    }
+
+    backend->clear(color);
+
+    if (active_layer < 0) {
+        background   = color;
+        cleared_full = true;
+    }
+}
+
+
+void draw_rect(Position2d position, Size2d size, RGBColor color, bool filled) {
+    flush_batch();
+    add_damage(position, size);
+
+    if (filled)
+        backend->fill_rect(position, size, color);
+    else
+        backend->draw_rect(position, size, color);
+}
+
+
+void draw_line(Position2d start, Position2d stop, RGBColor color) {
+    flush_batch();
+    add_damage(
+        Position2d{std::min(start.x, stop.x), std::min(start.y, stop.y)},
+        Size2d{std::abs(stop.x - start.x) + 1, std::abs(stop.y - start.y) + 1}
+    );
+    backend->draw_line(start, stop, color);
+}
+
+
+// Returns the cached image for the text, rendering it on a miss. Texts drawn every frame are
+// only rasterized once, and the least recently used image is destroyed when the cache is full.
+static TextCacheEntry* cached_text(const char* text, TTF_Font *font, RGBColor color, bool aliasing) {
+    size_t hash = std::hash<std::string_view>()(text);
+    hash ^= std::hash<const void*>()(font) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    hash ^= ((size_t)color.r << 16 | (size_t)color.g << 8 | color.b | (size_t)aliasing << 24) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+
+    auto found = text_cache_index.find(hash);
+    if (found != text_cache_index.end()) {
+        TextCacheEntry& entry = *found->second;
+
+        bool same_key = entry.font == font && entry.aliasing == aliasing && entry.text == text &&
+                        entry.color.r == color.r && entry.color.g == color.g && entry.color.b == color.b;
+
+        if (same_key) {
+            text_cache.splice(text_cache.begin(), text_cache, found->second);
+            return &entry;
+        }
+
+        // Hash collision, the new text replaces the old one
+        backend->destroy_text_image(entry.image);
+        text_cache.erase(found->second);
+        text_cache_index.erase(found);
+    }
+
+    SDL_Surface* text_surface;
+
+    if (aliasing)
+        text_surface = TTF_RenderText_Blended(font, text, {color.r, color.g, color.b, 0});
+    else
+        text_surface = TTF_RenderText_Solid(font, text, {color.r, color.g, color.b, 0});
+
+    if (text_surface == nullptr) {
+        std::cout << RED << "[SG ERROR]" << CLEAR << " Unable to render text surface." << std::endl;
+        return nullptr;
+    }
+
+    void* text_image = backend->create_text_image(text_surface);
+    int width  = text_surface->w;
+    int height = text_surface->h;
+
+    // Free the text surface now that we have an image
+    SDL_FreeSurface(text_surface);
+
+    if (text_image == nullptr) {
+        std::cout << RED << "[SG ERROR]" << CLEAR << " Unable to create image from text surface." << std::endl;
+        return nullptr;
+    }
+
+    if (text_cache.size() >= TEXT_CACHE_SIZE) {
+        backend->destroy_text_image(text_cache.back().image);
+        text_cache_index.erase(text_cache.back().hash);
+        text_cache.pop_back();
+    }
+
+    text_cache.push_front(TextCacheEntry{hash, text, font, color, aliasing, text_image, width, height});
+    text_cache_index[hash] = text_cache.begin();
+
+    return &text_cache.front();
+}
+
+
+void draw_text(const char* text, Position2d position, TTF_Font *font, RGBColor color, bool aliasing) {
+    flush_batch();
+
+    TextCacheEntry* entry = cached_text(text, font, color, aliasing);
+    if (entry == nullptr) return;
+
+    add_damage(position, Size2d{entry->width, entry->height});
+    backend->draw_text_image(entry->image, position, Size2d{entry->width, entry->height});
+}
+
+
+void invalidate_text_cache(TTF_Font *font) {
+    for (auto entry = text_cache.begin(); entry != text_cache.end();) {
+        if (font != nullptr && entry->font != font) {
+            ++entry;
+            continue;
+        }
+
+        backend->destroy_text_image(entry->image);
+        text_cache_index.erase(entry->hash);
+        entry = text_cache.erase(entry);
+    }
+}
+
+
+
+// --- BATCHED GRAPHICS ---
+
+void batch_rect(Position2d position, Size2d size, RGBColor color) {
+    add_damage(position, size);
+    backend->batch_rect(position, size, color);
+}
+
+
+void flush_batch() {
+    if (backend) backend->flush_batch();
+}
+
+
+
+// --- LAYERS ---
+
+static void release_layers() {
+    for (Layer& layer : layers) {
+        if (layer.image != nullptr && backend) backend->destroy_layer_image(layer.image);
+        layer.image = nullptr;
+        layer.valid = false;
+    }
+}
+
+
+int create_layer() {
+    layers.push_back(Layer{});
+    return (int)layers.size() - 1;
+}
+
+
+bool layer_valid(int layer) {
+    return layers[layer].valid;
+}
+
+
+void invalidate_layer(int layer) {
+    layers[layer].valid = false;
+}
+
+
+void begin_layer(int layer) {
+    flush_batch();
+
+    Layer& target = layers[layer];
+    if (target.image == nullptr) {
+        target.image = backend->create_layer_image();
+    }
+
+    // Not supported, the content goes straight to the display
+    if (target.image == nullptr) return;
+
+    backend->begin_layer_image(target.image);
+    target.damage.clear();
+    active_layer = layer;
+}
+
+
+void end_layer() {
+    if (active_layer < 0) return;
+
+    flush_batch();
+    backend->end_layer_image();
+
+    layers[active_layer].valid = true;
+    active_layer = -1;
+}
+
+
+void draw_layer(int layer) {
+    flush_batch();
+
+    if (layers[layer].valid) {
+        backend->draw_layer_image(layers[layer].image);
+
+        for (const DamageRect& rect : layers[layer].damage) {
+            add_damage(rect.position, rect.size);
+        }
+    }
+}
+
+
+
+// --- DAMAGE TRACKING ---
+
+static void add_damage(Position2d position, Size2d size) {
+    int left   = std::max(0, position.x);
+    int top    = std::max(0, position.y);
+    int right  = std::min((int)window_width,  position.x + size.width);
+    int bottom = std::min((int)window_height, position.y + size.height);
+    if (left >= right || top >= bottom) return;
+
+    DamageRect rect = {Position2d{left, top}, Size2d{right - left, bottom - top}};
+
+    // A layer keeps its own damage, it is added to the frame whenever the layer is drawn
+    if (active_layer >= 0) {
+        layers[active_layer].damage.push_back(rect);
+        return;
+    }
+
+    if (drawn_overflow) return;
+
+    if (drawn.size() >= DAMAGE_MAX_RECTS) {
+        drawn_overflow = true;
+        drawn.clear();
+        return;
+    }
+
+    drawn.push_back(rect);
+}
+
+
+static void reset_damage() {
+    drawn.clear();
+    previous_drawn.clear();
+    drawn_overflow    = false;
+    previous_overflow = true;
+    cleared_full      = false;
+}
+
+
+const std::vector<DamageRect>& frame_damage() {
+    return presented_damage;
+}
+
+
+void set_damage_overlay(bool enabled) {
+    damage_overlay = enabled;
+}
+
+
+} // namespace simple_graphics
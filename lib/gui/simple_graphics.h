@@ -1,45 +1,99 @@
-#ifndef _SIMPLE_GRAPHICS_H_
-#define _SIMPLE_GRAPHICS_H_
-
-#include "../main.h"
-
-
-struct RGBColor {
-    uint8_t r, g, b;
-};
-
-struct Position2d {
-    int x, y;
-};
-
-struct Size2d {
-    int width, height;
-};
-
-
-namespace simple_graphics {
-
-    // Variables to be accessed from outside
-    extern TTF_Font *font24;
-    extern TTF_Font *font16;
-    extern uint16_t  window_width;
-    extern uint16_t  window_height;
-    extern std::vector<SDL_Keycode> KEYS_PRESSED;
-
-    // Window handling
-    bool   init();
-    bool   create_display(const char* title, uint16_t width = 800, uint16_t height = 600, uint32_t flags = 0);
-    void   update_display();
-    void   close_display();
-    double limit_fps(uint fps = 60);
-
-    // Graphics
-    void fill_display(RGBColor color);
-    void draw_rect(Position2d position, Size2d size, RGBColor color, bool filled);
-    void draw_line(Position2d start, Position2d stop, RGBColor color);
-    void draw_text(const char* text, Position2d position, TTF_Font *font, RGBColor color, bool aliasing);
-
-}
-
-
-#endif
+#ifndef _SIMPLE_GRAPHICS_H_
+#define _SIMPLE_GRAPHICS_H_
+
+#include "../main.h"
+
+
+// Maximum number of rendered texts kept as textures (or images with the software renderer)
+#define TEXT_CACHE_SIZE 64
+
+// Damaged rectangles tracked per frame, beyond that the whole frame counts as damaged
+#define DAMAGE_MAX_RECTS 8192
+
+
+struct RGBColor {
+    uint8_t r, g, b;
+};
+
+struct Position2d {
+    int x, y;
+};
+
+struct Size2d {
+    int width, height;
+};
+
+struct DamageRect {
+    Position2d position;
+    Size2d     size;
+};
+
+
+namespace simple_graphics {
+
+    // Variables to be accessed from outside
+    extern TTF_Font *font24;
+    extern TTF_Font *font16;
+    extern uint16_t  window_width;
+    extern uint16_t  window_height;
+    extern std::vector<SDL_Keycode> KEYS_PRESSED;
+
+    // Window handling. The renderer is "sdl" for a window or "software" to rasterize into an
+    // in-memory framebuffer without creating a window.
+    bool   init(const char* renderer = "sdl");
+    bool   create_display(const char* title, uint16_t width = 800, uint16_t height = 600, uint32_t flags = 0, bool vsync = false);
+    void   update_display();
+    void   close_display();
+    double limit_fps(uint fps = 60);  // See FramePacer for more control
+
+    // RGBA pixels of the last frame with the software renderer (see pixel_kernels.h), nullptr otherwise
+    const uint32_t* framebuffer();
+
+    // Graphics
+    void fill_display(RGBColor color);
+    void draw_rect(Position2d position, Size2d size, RGBColor color, bool filled);
+    void draw_line(Position2d start, Position2d stop, RGBColor color);
+    void draw_text(const char* text, Position2d position, TTF_Font *font, RGBColor color, bool aliasing);
+
+    // Destroys the cached text textures of a font, or all of them if font is nullptr. Call this
+    // before closing or resizing a font, otherwise stale textures would keep being drawn.
+    void invalidate_text_cache(TTF_Font *font = nullptr);
+
+    // Batched graphics. Filled rectangles are collected and submitted together, which is much
+    // faster than draw_rect() for thousands of small shapes. The batch is flushed automatically
+    // before anything else is drawn and before the display is updated, so drawing order is kept.
+    void batch_rect(Position2d position, Size2d size, RGBColor color);
+    void flush_batch();
+
+    // Static layers. Content that rarely changes is drawn once into a layer and composited
+    // with a single copy per frame until the layer is invalidated:
+    //
+    //     if (!layer_valid(layer)) {
+    //         begin_layer(layer);
+    //         ... draw ...
+    //         end_layer();
+    //     }
+    //     draw_layer(layer);
+    //
+    // If the renderer can't draw into textures, the layer never becomes valid and its content
+    // is drawn straight onto the display every frame instead.
+    int  create_layer();
+    bool layer_valid(int layer);
+    void invalidate_layer(int layer);
+    void begin_layer(int layer);
+    void end_layer();
+    void draw_layer(int layer);
+
+    // Damage tracking. The bounds of everything drawn are recorded, and with a renderer that
+    // keeps the frame between presents (the software renderer) fill_display() only clears what
+    // the previous frame drew, as long as the color stays the same. The rest of the frame is
+    // still background. frame_damage() returns the regions that changed in the last presented
+    // frame, the video export copies only those out of framebuffer(). The overlay outlines what
+    // was drawn.
+    const std::vector<DamageRect>& frame_damage();
+    void set_damage_overlay(bool enabled);
+
+}
+
+
+#endif
@@ -0,0 +1,197 @@
+#include "render_backend.h"
+#include "pixel_kernels.h"
+
+
+// A transparent image of the display size. After drawing, the range of visible pixels of every
+// row is recorded, so compositing skips the empty parts.
+struct SoftwareLayer {
+    std::vector<uint32_t>            pixels;
+    std::vector<std::pair<int, int>> spans;  // [begin, end) per row
+};
+
+
+// Rasterizes on the CPU into an RGBA framebuffer. There is no window, so nothing is shown and
+// no keys are ever pressed; the frame is read back through framebuffer().
+class SoftwareBackend : public RenderBackend {
+
+public:
+    bool open(const char* title, uint16_t width, uint16_t height, uint32_t flags, bool vsync) override {
+        (void)title;
+        (void)flags;
+        (void)vsync;
+
+        this->width  = width;
+        this->height = height;
+        pixels.assign((size_t)width * height, pack_rgba(0, 0, 0));
+        canvas = pixels.data();
+
+        std::cout << GREEN << "[SG INFO]" << CLEAR << " Software framebuffer created (" << width << "x" << height << ")." << std::endl;
+
+        return true;
+    }
+
+    void close() override {
+        pixels.clear();
+        pixels.shrink_to_fit();
+        canvas = nullptr;
+    }
+
+    void present() override {}
+
+    void clear(RGBColor color) override {
+        fill_span(canvas, width * height, pack_rgba(color.r, color.g, color.b));
+    }
+
+    void fill_rect(Position2d position, Size2d size, RGBColor color) override {
+        int left   = std::max(0, position.x);
+        int top    = std::max(0, position.y);
+        int right  = std::min(width,  position.x + size.width);
+        int bottom = std::min(height, position.y + size.height);
+        if (left >= right || top >= bottom) return;
+
+        const uint32_t pixel = pack_rgba(color.r, color.g, color.b);
+        for (int y = top; y < bottom; y++) {
+            fill_span(&canvas[(size_t)y * width + left], right - left, pixel);
+        }
+    }
+
+    // Same pixels as SDL_RenderDrawRect: the outermost row and column of the rectangle
+    void draw_rect(Position2d position, Size2d size, RGBColor color) override {
+        if (size.width <= 0 || size.height <= 0) return;
+
+        fill_rect(position, Size2d{size.width, 1}, color);
+        fill_rect(Position2d{position.x, position.y + size.height - 1}, Size2d{size.width, 1}, color);
+        fill_rect(position, Size2d{1, size.height}, color);
+        fill_rect(Position2d{position.x + size.width - 1, position.y}, Size2d{1, size.height}, color);
+    }
+
+    void draw_line(Position2d start, Position2d stop, RGBColor color) override {
+        if (start.y == stop.y) {
+            fill_rect(Position2d{std::min(start.x, stop.x), start.y}, Size2d{std::abs(stop.x - start.x) + 1, 1}, color);
+            return;
+        }
+
+        if (start.x == stop.x) {
+            fill_rect(Position2d{start.x, std::min(start.y, stop.y)}, Size2d{1, std::abs(stop.y - start.y) + 1}, color);
+            return;
+        }
+
+        // Bresenham, both end points included
+        const uint32_t pixel = pack_rgba(color.r, color.g, color.b);
+        int dx = std::abs(stop.x - start.x), sx = start.x < stop.x ? 1 : -1;
+        int dy = -std::abs(stop.y - start.y), sy = start.y < stop.y ? 1 : -1;
+        int error = dx + dy;
+        int x = start.x, y = start.y;
+
+        while (true) {
+            if (x >= 0 && x < width && y >= 0 && y < height) {
+                canvas[(size_t)y * width + x] = pixel;
+            }
+
+            if (x == stop.x && y == stop.y) break;
+
+            int doubled = 2 * error;
+            if (doubled >= dy) { error += dy; x += sx; }
+            if (doubled <= dx) { error += dx; y += sy; }
+        }
+    }
+
+    // The text is kept as an RGBA surface with the glyph coverage in the alpha channel
+    void* create_text_image(SDL_Surface* surface) override {
+        return SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_RGBA32, 0);
+    }
+
+    void destroy_text_image(void* image) override {
+        SDL_FreeSurface((SDL_Surface*)image);
+    }
+
+    void draw_text_image(void* image, Position2d position, Size2d size) override {
+        SDL_Surface* surface = (SDL_Surface*)image;
+
+        int left   = std::max(0, position.x);
+        int top    = std::max(0, position.y);
+        int right  = std::min({width,  position.x + size.width,  position.x + surface->w});
+        int bottom = std::min({height, position.y + size.height, position.y + surface->h});
+        if (left >= right || top >= bottom) return;
+
+        for (int y = top; y < bottom; y++) {
+            const uint8_t* row = (const uint8_t*)surface->pixels + (size_t)(y - position.y) * surface->pitch;
+            blend_span(&canvas[(size_t)y * width + left], (const uint32_t*)row + (left - position.x), right - left);
+        }
+    }
+
+    // Nothing to gain from batching on the CPU, the rectangles are filled right away
+    void batch_rect(Position2d position, Size2d size, RGBColor color) override {
+        fill_rect(position, size, color);
+    }
+
+    void flush_batch() override {}
+
+    void* create_layer_image() override {
+        SoftwareLayer* layer = new SoftwareLayer();
+        layer->pixels.resize((size_t)width * height);
+        layer->spans.resize(height);
+        return layer;
+    }
+
+    void destroy_layer_image(void* image) override {
+        delete (SoftwareLayer*)image;
+    }
+
+    void begin_layer_image(void* image) override {
+        active_layer = (SoftwareLayer*)image;
+        canvas = active_layer->pixels.data();
+        fill_span(canvas, width * height, 0);
+    }
+
+    void end_layer_image() override {
+        if (active_layer == nullptr) return;
+
+        for (int y = 0; y < height; y++) {
+            const uint32_t* row = &active_layer->pixels[(size_t)y * width];
+            int begin = 0, end = width;
+            while (begin < end && (row[begin] >> 24) == 0) begin++;
+            while (end > begin && (row[end - 1] >> 24) == 0) end--;
+            active_layer->spans[y] = {begin, end};
+        }
+
+        active_layer = nullptr;
+        canvas = pixels.data();
+    }
+
+    void draw_layer_image(void* image) override {
+        const SoftwareLayer* layer = (const SoftwareLayer*)image;
+
+        for (int y = 0; y < height; y++) {
+            auto [begin, end] = layer->spans[y];
+            if (begin >= end) continue;
+
+            size_t row = (size_t)y * width;
+            blend_span(&canvas[row + begin], &layer->pixels[row + begin], end - begin);
+        }
+    }
+
+    bool retains_frame() const override {
+        return true;
+    }
+
+    const uint32_t* framebuffer() const override {
+        return pixels.data();
+    }
+
+
+private:
+    int width  = 0;
+    int height = 0;
+    std::vector<uint32_t> pixels;
+
+    // Where drawing goes, the display or the layer being drawn
+    uint32_t*      canvas       = nullptr;
+    SoftwareLayer* active_layer = nullptr;
+
+};
+
+
+std::unique_ptr<RenderBackend> create_software_backend() {
+    return std::make_unique<SoftwareBackend>();
+}
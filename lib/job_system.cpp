@@ -0,0 +1,293 @@
+#include "job_system.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+
+
+namespace {
+
+struct Batch {
+    const std::function<void(size_t, size_t)>* body = nullptr;
+    std::atomic<size_t> remaining{0};
+};
+
+struct Chunk {
+    Batch* batch = nullptr;
+    size_t begin = 0;
+    size_t end   = 0;
+};
+
+// Double-ended queue of chunks in a ring that only ever grows. Unlike std::deque, which
+// allocates and frees blocks as the chunks move through it, it stops allocating once the
+// largest batch has been queued.
+class ChunkQueue {
+
+public:
+    ChunkQueue() : ring(16) {}
+
+    bool empty() const { return count == 0; }
+
+    void push_back(const Chunk& chunk) {
+        if (count == ring.size()) grow();
+        ring[(first + count) % ring.size()] = chunk;
+        count++;
+    }
+
+    Chunk pop_back() {
+        count--;
+        return ring[(first + count) % ring.size()];
+    }
+
+    Chunk pop_front() {
+        Chunk chunk = ring[first];
+        first = (first + 1) % ring.size();
+        count--;
+        return chunk;
+    }
+
+
+private:
+    std::vector<Chunk> ring;
+    size_t first = 0;
+    size_t count = 0;
+
+    void grow() {
+        std::vector<Chunk> larger(ring.size() * 2);
+        for (size_t i = 0; i < count; i++) larger[i] = ring[(first + i) % ring.size()];
+
+        ring.swap(larger);
+        first = 0;
+    }
+
+};
+
+// One per thread. Padded so that neighbouring threads don't write to the same cache line.
+struct alignas(64) ThreadState {
+    std::mutex mutex;
+    ChunkQueue chunks;
+    uint64_t   busy_ns = 0;  // Only written by the owning thread
+};
+
+}
+
+
+static std::vector<std::thread> workers;
+static std::vector<std::unique_ptr<ThreadState>> states;  // Index 0 belongs to the calling thread
+static std::vector<uint64_t> busy_before;  // Snapshot of every busy_ns in parallel_for(), sized in init()
+
+static std::mutex              wake_mutex;
+static std::condition_variable wake;
+static std::atomic<long>       queued_chunks{0};
+static bool                    stopping = false;
+
+static std::vector<job_system::JobStats> job_stats;
+
+
+// Newest chunk of the own queue first, then the oldest chunk of any other queue
+static bool take_chunk(size_t self, Chunk& chunk) {
+    {
+        ThreadState& state = *states[self];
+        std::lock_guard<std::mutex> lock(state.mutex);
+        if (!state.chunks.empty()) {
+            chunk = state.chunks.pop_back();
+            queued_chunks.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < states.size(); i++) {
+        ThreadState& victim = *states[(self + i) % states.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.chunks.empty()) {
+            chunk = victim.chunks.pop_front();
+            queued_chunks.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static void run_chunk(size_t self, const Chunk& chunk) {
+    auto start = std::chrono::steady_clock::now();
+    (*chunk.batch->body)(chunk.begin, chunk.end);
+    auto stop = std::chrono::steady_clock::now();
+
+    states[self]->busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+
+    // The batch lives on the stack of parallel_for(), it must not be touched after this
+    chunk.batch->remaining.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+
+static void worker_loop(size_t self) {
+    Chunk chunk;
+
+    while (true) {
+        if (take_chunk(self, chunk)) {
+            run_chunk(self, chunk);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wake_mutex);
+        wake.wait(lock, [] { return stopping || queued_chunks.load(std::memory_order_relaxed) > 0; });
+        if (stopping) return;
+    }
+}
+
+
+bool job_system::init(int thread_count) {
+    shutdown();
+
+    if (thread_count <= 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (int i = 0; i < thread_count; i++) {
+        states.push_back(std::make_unique<ThreadState>());
+    }
+
+    busy_before.assign(thread_count, 0);
+
+    for (int i = 1; i < thread_count; i++) {
+        workers.emplace_back(worker_loop, (size_t)i);
+    }
+
+    reset_stats();
+
+    std::cout << GREEN << "[JS INFO]" << CLEAR << " Job system running on " << thread_count
+              << (thread_count == 1 ? " thread (deterministic mode)." : " threads.") << std::endl;
+
+    return true;
+}
+
+
+void job_system::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (std::thread& worker : workers) {
+        if (worker.joinable()) worker.join();
+    }
+
+    workers.clear();
+    states.clear();
+    queued_chunks.store(0, std::memory_order_relaxed);
+    stopping = false;
+}
+
+
+int job_system::thread_count() {
+    return std::max<int>(1, states.size());
+}
+
+
+void job_system::parallel_for(const char* name, size_t count, size_t min_chunk, const std::function<void(size_t, size_t)>& body) {
+    if (count == 0) return;
+
+    auto start = std::chrono::steady_clock::now();
+
+    // A few chunks per thread so that stealing can even out uneven chunks
+    const size_t threads     = thread_count();
+    const size_t chunk_size  = std::max<size_t>({1, min_chunk, (count + threads * 4 - 1) / (threads * 4)});
+    const size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+
+    // Busy time of this call per thread, measured as the growth of the counters
+    for (size_t i = 0; i < states.size(); i++) busy_before[i] = states[i]->busy_ns;
+
+    if (workers.empty() || chunk_count == 1) {
+        // Single-threaded, every chunk in order on the calling thread
+        for (size_t begin = 0; begin < count; begin += chunk_size) {
+            body(begin, std::min(count, begin + chunk_size));
+        }
+
+        if (!states.empty()) {
+            states[0]->busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+    } else {
+        Batch batch;
+        batch.body = &body;
+        batch.remaining.store(chunk_count, std::memory_order_relaxed);
+
+        for (size_t i = 0; i < chunk_count; i++) {
+            size_t begin = i * chunk_size;
+            ThreadState& state = *states[i % threads];
+            std::lock_guard<std::mutex> lock(state.mutex);
+            state.chunks.push_back(Chunk{&batch, begin, std::min(count, begin + chunk_size)});
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            queued_chunks.fetch_add(chunk_count, std::memory_order_relaxed);
+        }
+        wake.notify_all();
+
+        // Help until everything is taken, then wait for the chunks still running elsewhere
+        Chunk chunk;
+        while (batch.remaining.load(std::memory_order_acquire) > 0) {
+            if (take_chunk(0, chunk)) {
+                run_chunk(0, chunk);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    JobStats* job = nullptr;
+    for (JobStats& existing : job_stats) {
+        if (existing.name == name) job = &existing;
+    }
+
+    if (job == nullptr) {
+        job_stats.push_back(JobStats{});
+        job = &job_stats.back();
+        job->name = name;
+    }
+
+    job->busy_ms.resize(threads, 0.0);
+    for (size_t i = 0; i < states.size(); i++) {
+        job->busy_ms[i] += (states[i]->busy_ns - busy_before[i]) / 1e6;
+    }
+
+    job->runs++;
+    job->chunks  += chunk_count;
+    job->total_ms += elapsed_ms;
+    job->last_ms  = elapsed_ms;
+    job->max_ms   = std::max(job->max_ms, elapsed_ms);
+}
+
+
+std::vector<job_system::JobStats> job_system::stats() {
+    return job_stats;
+}
+
+
+void job_system::reset_stats() {
+    job_stats.clear();
+}
+
+
+void job_system::print_stats() {
+    for (const JobStats& job : job_stats) {
+        if (job.runs == 0) continue;
+
+        double busy_total = 0;
+        for (double busy : job.busy_ms) busy_total += busy;
+
+        // How much of the available thread time was spent running chunks
+        double utilization = job.total_ms > 0 ? busy_total / (job.total_ms * job.busy_ms.size()) : 0;
+
+        char line[256];
+        snprintf(line, sizeof(line), "%s: %llu runs, %.3f ms avg, %.3f ms max, %.1f chunks/run, %.0f%% of %zu threads busy",
+            job.name.c_str(), (unsigned long long)job.runs, job.total_ms / job.runs, job.max_ms,
+            (double)job.chunks / job.runs, utilization * 100, job.busy_ms.size());
+
+        std::cout << GREEN << "[JS INFO]" << CLEAR << " " << line << std::endl;
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef _JOB_SYSTEM_H_
+#define _JOB_SYSTEM_H_
+
+
+#include "main.h"
+#include <functional>
+
+
+// A small pool of persistent worker threads for splitting per-frame work into chunks.
+//
+// Every thread, including the one calling parallel_for(), owns a queue of chunks. A thread
+// takes work from the back of its own queue and steals from the front of the others when it
+// runs out, so uneven chunks still keep all cores busy. The calling thread always helps, and
+// parallel_for() only returns once every chunk has finished.
+//
+// With a thread count of 1 no workers are started and every chunk runs in order on the calling
+// thread, which makes the results deterministic.
+namespace job_system {
+
+    // Per parallel_for() name timing, used to measure how the work scales with the thread count
+    struct JobStats {
+        std::string         name;
+        uint64_t            runs     = 0;
+        uint64_t            chunks   = 0;
+        double              total_ms = 0;  // Wall time of all runs
+        double              last_ms  = 0;
+        double              max_ms   = 0;
+        std::vector<double> busy_ms;       // Time each thread spent running chunks, index 0 is the caller
+    };
+
+    // 0 uses every available core. Calling init() again restarts the pool with the new count.
+    bool init(int thread_count);
+    void shutdown();
+
+    int thread_count();
+
+    // Runs body(begin, end) over [0, count) in chunks of at least min_chunk items. Must not be
+    // called from inside a job.
+    void parallel_for(const char* name, size_t count, size_t min_chunk, const std::function<void(size_t, size_t)>& body);
+
+    std::vector<JobStats> stats();
+    void reset_stats();
+    void print_stats();
+}
+
+
+#endif
@@ -37,7 +37,8 @@
 // Uncomment the following line if you want the Audio Visualizer to be in fullscreen mode.
 //#define FLAGS SDL_WINDOW_FULLSCREEN_DESKTOP
 
-// Only change the input device if you know what you are doing.
+// Only change the input device if you know what you are doing. More inputs can be analyzed at
+// the same time with --inputs, only the first one is played back.
 #define INPUT_DEVICE "hw:Loopback,1"
 
 // The output device can be set to "default" or "hw:1,0" or "hw:[device name],0" etc., depending on
@@ -0,0 +1,239 @@
+#include "profiler.h"
+
+#ifndef PROFILER_DISABLED
+
+#include "gui/simple_graphics.h"
+#include <memory>
+
+
+// The frame time comes first, then one column per stage
+#define PROFILER_COLUMNS ((size_t)ProfileStage::Count + 1)
+
+
+namespace {
+
+// Written by one thread and drained by the render thread. The owning thread only advances
+// head, the render thread only advances tail.
+struct ThreadRing {
+    uint64_t              durations[PROFILER_RING_EVENTS];
+    ProfileStage          stages[PROFILER_RING_EVENTS];
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+};
+
+}
+
+
+static const char* const COLUMN_NAMES[PROFILER_COLUMNS] = {
+    "frame", "capture", "analysis", "fft", "bands", "heights", "update", "particles", "text", "bars", "present", "wait"
+};
+
+std::atomic<bool> profiler::active{false};
+
+// The rings stay alive until the process exits, a thread might still hold a pointer to its own
+static std::mutex ring_mutex;
+static std::vector<std::unique_ptr<ThreadRing>> rings;
+static std::atomic<uint64_t> dropped_events{0};
+
+static uint64_t frame_totals[PROFILER_COLUMNS] = {};
+static uint64_t previous_frame_end = 0;
+static uint64_t frames = 0;
+
+// Per-frame milliseconds of the last PROFILER_HISTORY frames, one row per frame
+static std::vector<float> history;
+static std::vector<float> sorted;
+
+static bool  hud_enabled = false;
+static FILE* csv_file    = nullptr;
+
+static std::vector<std::string> hud_lines;
+static uint64_t hud_refreshed = 0;
+
+
+void profiler::record(ProfileStage stage, uint64_t duration_ns) {
+    thread_local ThreadRing* ring = nullptr;
+
+    if (ring == nullptr) {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        rings.push_back(std::make_unique<ThreadRing>());
+        ring = rings.back().get();
+    }
+
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+
+    // Nobody collected the events for a while, e.g. while the window was being dragged
+    if (head - ring->tail.load(std::memory_order_acquire) >= PROFILER_RING_EVENTS) {
+        dropped_events.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    ring->durations[head % PROFILER_RING_EVENTS] = duration_ns;
+    ring->stages[head % PROFILER_RING_EVENTS]    = stage;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+
+bool profiler::init(bool hud, const std::string& csv_path) {
+    hud_enabled = hud;
+
+    history.assign(PROFILER_HISTORY * PROFILER_COLUMNS, 0.f);
+    sorted.reserve(PROFILER_HISTORY);
+    hud_lines.assign(PROFILER_COLUMNS + 1, std::string());
+
+    if (!csv_path.empty()) {
+        csv_file = fopen(csv_path.c_str(), "w");
+        if (csv_file == nullptr) {
+            std::cout << RED << "[PF ERROR]" << CLEAR << " Unable to open " << csv_path << " for writing." << std::endl;
+            return false;
+        }
+
+        for (size_t column = 0; column < PROFILER_COLUMNS; column++) {
+            fprintf(csv_file, "%s%s_ms", column == 0 ? "frame_index," : ",", COLUMN_NAMES[column]);
+        }
+        fputc('\n', csv_file);
+    }
+
+    // Without a consumer for the timings the scopes don't even read the clock
+    active.store(hud || csv_file != nullptr, std::memory_order_relaxed);
+
+    return true;
+}
+
+
+void profiler::shutdown() {
+    active.store(false, std::memory_order_relaxed);
+
+    if (csv_file != nullptr) {
+        fclose(csv_file);
+        csv_file = nullptr;
+    }
+}
+
+
+void profiler::end_frame() {
+    if (!active.load(std::memory_order_relaxed)) return;
+
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+
+        for (std::unique_ptr<ThreadRing>& ring : rings) {
+            uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+
+            for (; tail < head; tail++) {
+                frame_totals[(size_t)ring->stages[tail % PROFILER_RING_EVENTS] + 1] += ring->durations[tail % PROFILER_RING_EVENTS];
+            }
+
+            ring->tail.store(head, std::memory_order_release);
+        }
+    }
+
+    uint64_t now = now_ns();
+
+    // The first frame has no start, its events are dropped
+    if (previous_frame_end != 0) {
+        frame_totals[0] = now - previous_frame_end;
+
+        float* row = &history[(frames % PROFILER_HISTORY) * PROFILER_COLUMNS];
+        for (size_t column = 0; column < PROFILER_COLUMNS; column++) {
+            row[column] = frame_totals[column] / 1e6f;
+        }
+
+        if (csv_file != nullptr) {
+            fprintf(csv_file, "%llu", (unsigned long long)frames);
+            for (size_t column = 0; column < PROFILER_COLUMNS; column++) {
+                fprintf(csv_file, ",%.4f", row[column]);
+            }
+            fputc('\n', csv_file);
+        }
+
+        frames++;
+    }
+
+    previous_frame_end = now;
+    std::fill(std::begin(frame_totals), std::end(frame_totals), 0);
+}
+
+
+// p50, p99 and max of a column over the recorded history
+static void column_percentiles(size_t column, float& p50, float& p99, float& max) {
+    size_t count = std::min<uint64_t>(frames, PROFILER_HISTORY);
+
+    sorted.clear();
+    for (size_t row = 0; row < count; row++) {
+        sorted.push_back(history[row * PROFILER_COLUMNS + column]);
+    }
+
+    if (sorted.empty()) {
+        p50 = p99 = max = 0;
+        return;
+    }
+
+    std::sort(sorted.begin(), sorted.end());
+    p50 = sorted[sorted.size() / 2];
+    p99 = sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+    max = sorted.back();
+}
+
+
+void profiler::draw_hud() {
+    if (!hud_enabled || !active.load(std::memory_order_relaxed)) return;
+
+    // Rebuilding the texts every frame would render new text images every frame and make them
+    // unreadable anyway
+    uint64_t now = now_ns();
+    if (now - hud_refreshed >= PROFILER_HUD_REFRESH_MS * 1000000ull) {
+        hud_refreshed = now;
+
+        char line[64];
+        snprintf(line, sizeof(line), "%-10s %7s %7s %7s", "ms", "p50", "p99", "max");
+        hud_lines[0] = line;
+
+        for (size_t column = 0; column < PROFILER_COLUMNS; column++) {
+            float p50, p99, max;
+            column_percentiles(column, p50, p99, max);
+
+            snprintf(line, sizeof(line), "%-10s %7.2f %7.2f %7.2f", COLUMN_NAMES[column], p50, p99, max);
+            hud_lines[column + 1] = line;
+        }
+    }
+
+    const int line_height = 20;
+    const int box_width   = 340;
+    const int box_height  = (int)hud_lines.size() * line_height + 10;
+    const int left        = simple_graphics::window_width - box_width - 10;
+
+    simple_graphics::draw_rect(Position2d{left, 10}, Size2d{box_width, box_height}, RGBColor{20, 20, 20}, true);
+
+    for (size_t i = 0; i < hud_lines.size(); i++) {
+        if (hud_lines[i].empty()) continue;
+
+        simple_graphics::draw_text(
+            hud_lines[i].c_str(), Position2d{left + 10, 15 + (int)i * line_height},
+            simple_graphics::font16, RGBColor{200, 200, 200}, true
+        );
+    }
+}
+
+
+void profiler::print_stats() {
+    if (frames == 0) return;
+
+    for (size_t column = 0; column < PROFILER_COLUMNS; column++) {
+        float p50, p99, max;
+        column_percentiles(column, p50, p99, max);
+
+        char line[128];
+        snprintf(line, sizeof(line), "%s: %.3f ms p50, %.3f ms p99, %.3f ms max", COLUMN_NAMES[column], p50, p99, max);
+
+        std::cout << GREEN << "[PF INFO]" << CLEAR << " " << line << std::endl;
+    }
+
+    uint64_t dropped = dropped_events.load(std::memory_order_relaxed);
+    if (dropped > 0) {
+        std::cout << YELLOW << "[PF WARN]" << CLEAR << " " << dropped << " events were dropped because a ring buffer was full." << std::endl;
+    }
+}
+
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+
+#include "main.h"
+#include <atomic>
+
+
+// Timed events each thread can record before the render thread collects them
+#define PROFILER_RING_EVENTS 4096
+
+// Frames the HUD percentiles are computed over, and how often the HUD texts are rebuilt
+#define PROFILER_HISTORY        600
+#define PROFILER_HUD_REFRESH_MS 500
+
+
+// The parts of a frame that are timed. Capture runs on the audio thread, the analysis stages on
+// the analysis workers and everything else on the render thread.
+enum class ProfileStage : uint8_t {
+    Capture,      // Moving a period from the capture device to the ring buffer and the playback device
+    Analysis,     // All of the analysis of the new hops, including the two stages below
+    Fft,          // The FFTs alone
+    BandMapping,  // Spectrum bins to band intensities
+    Heights,      // Intensities to bar heights
+    Update,       // Particle and bar simulation steps
+    Particles,    // Drawing the particles
+    Text,         // Title, labels and the box, usually just the cached layer
+    Bars,         // Drawing the bars
+    Present,      // Submitting the frame and polling events
+    Wait,         // Frame pacing
+    Count
+};
+
+
+// Scoped timing of the frame stages. Every thread records into its own ring buffer without
+// locking, the render thread drains them once per frame in end_frame(). The per-frame totals
+// are kept for rolling percentiles (drawn by draw_hud()) and can be written to a CSV file.
+//
+// Compiling with -DPROFILER_DISABLED removes the scopes and turns every call into an empty
+// inline function.
+namespace profiler {
+
+#ifndef PROFILER_DISABLED
+
+    extern std::atomic<bool> active;
+
+    inline uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void record(ProfileStage stage, uint64_t duration_ns);
+
+    class Scope {
+
+    public:
+        Scope(ProfileStage stage) : stage(stage), start(active.load(std::memory_order_relaxed) ? now_ns() : 0) {}
+
+        ~Scope() {
+            if (start != 0) record(stage, now_ns() - start);
+        }
+
+    private:
+        ProfileStage stage;
+        uint64_t     start;
+
+    };
+
+    // Starts recording if there is a HUD or a CSV file to record for. An empty csv_path writes
+    // no CSV file.
+    bool init(bool hud, const std::string& csv_path);
+    void shutdown();
+
+    // Collects the events of every thread into the timings of the frame that just ended
+    void end_frame();
+
+    // Rolling p50/p99/max of every stage, in the top right corner of the display
+    void draw_hud();
+
+    void print_stats();
+
+#else
+
+    inline bool init(bool, const std::string&) { return true; }
+    inline void shutdown() {}
+    inline void end_frame() {}
+    inline void draw_hud() {}
+    inline void print_stats() {}
+
+#endif
+
+}
+
+
+#ifndef PROFILER_DISABLED
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b)  PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(stage)  profiler::Scope PROFILE_CONCAT(profile_scope_, __LINE__)(ProfileStage::stage)
+#else
+#define PROFILE_SCOPE(stage)
+#endif
+
+
+#endif
@@ -0,0 +1,226 @@
+#include "settings.h"
+#include <climits>
+
+
+Settings settings;
+
+
+static void print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "  --config <file>        Read settings from file (default: " << SETTINGS_FILE << ")\n"
+              << "  --channels <n>         Number of capture channels\n"
+              << "  --sample-rate <hz>     Capture sample rate\n"
+              << "  --fft-size <n>         Analysis window length in samples\n"
+              << "  --hop-size <n>         Samples between consecutive spectra\n"
+              << "  --bars <n>             Number of frequency bands\n"
+              << "  --window <name>        hann, blackman-harris or rectangular\n"
+              << "  --analysis <name>      linear (one FFT) or multires (finer bins for the bass bands)\n"
+              << "  --inputs <devices>     Space separated capture devices, each analyzed and drawn separately\n"
+              << "  --analysis-threads <n> Analysis workers shared by the inputs (default: one per input)\n"
+              << "  --particles <n>        Number of background particles\n"
+              << "  --renderer <name>      sdl or software (headless, no window or GPU needed)\n"
+              << "  --fps <n>              Target frame rate, e.g. 60, 120 or 144 (also used by --export)\n"
+              << "  --vsync <on|off>       Present frames in sync with the display refresh\n"
+              << "  --sim-rate <hz>        Fixed simulation steps per second\n"
+              << "  --profiler-hud <on|off>  Show per-stage frame timings (p50/p99/max) on screen\n"
+              << "  --profiler-csv <file>  Write the per-stage timings of every frame as CSV\n"
+              << "  --damage-overlay <on|off> Outline the regions that are redrawn every frame\n"
+              << "  --count-allocations <on|off> Report heap allocations of every frame after the warm-up\n"
+              << "  --shm <name>           Publish the spectra in shared memory for other programs, e.g. /audio_visualizer\n"
+              << "  --threads <n>          Threads for the particle and bar updates (default: all cores, 1: deterministic)\n"
+              << "  --offline <file>       Analyze a WAV or raw PCM file without audio devices or a window\n"
+              << "  --export <file>        Render the visualization of a WAV or raw PCM file as raw video, faster than real time\n"
+              << "  --output <file>        Offline band intensities as CSV (.bin for binary), or the exported video (- for stdout)\n"
+              << "  --video-format <name>  yuv420p or rgb24 pixels for --export\n"
+              << "  --help                 Show this message" << std::endl;
+}
+
+
+// Positive values up to the given maximum, larger ones would wrap around
+static bool parse_uint(const std::string& value, unsigned int& result, unsigned long maximum = UINT_MAX) {
+    try {
+        size_t end;
+        long parsed = std::stol(value, &end);
+        if (end != value.size() || parsed <= 0 || (unsigned long)parsed > maximum) return false;
+        result = parsed;
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+
+
+static bool parse_int(const std::string& value, int& result) {
+    unsigned int parsed;
+    if (!parse_uint(value, parsed, INT_MAX)) return false;
+    result = parsed;
+    return true;
+}
+
+
+// For counts where 0 has a meaning, e.g. "every core"
+static bool parse_count(const std::string& value, int& result) {
+    if (value == "0") {
+        result = 0;
+        return true;
+    }
+    return parse_int(value, result);
+}
+
+
+static bool parse_list(const std::string& value, std::vector<std::string>& result) {
+    std::vector<std::string> items;
+    size_t start = value.find_first_not_of(" \t");
+
+    while (start != std::string::npos) {
+        size_t end = value.find_first_of(" \t", start);
+        items.push_back(value.substr(start, end - start));
+        start = value.find_first_not_of(" \t", end);
+    }
+
+    if (items.empty()) return false;
+    result = items;
+    return true;
+}
+
+
+static bool parse_bool(const std::string& value, bool& result) {
+    if (value == "on" || value == "true" || value == "1") {
+        result = true;
+    } else if (value == "off" || value == "false" || value == "0") {
+        result = false;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+// Applies a single setting, shared by the settings file and the command line
+static bool apply_setting(const std::string& key, const std::string& value) {
+    bool valid = true;
+
+    if      (key == "channels")    valid = parse_uint(value, settings.channels);
+    else if (key == "sample-rate") valid = parse_uint(value, settings.sample_rate);
+    else if (key == "fft-size")    valid = parse_int(value, settings.fft_size);
+    else if (key == "hop-size")    valid = parse_int(value, settings.hop_size);
+    else if (key == "bars")        valid = parse_int(value, settings.band_count);
+    else if (key == "window")      settings.window = value;
+    else if (key == "analysis")    settings.analysis = value;
+    else if (key == "inputs")      valid = parse_list(value, settings.inputs);
+    else if (key == "analysis-threads") valid = parse_count(value, settings.analysis_threads);
+    else if (key == "particles")   valid = parse_int(value, settings.particle_count);
+    else if (key == "threads")     valid = parse_count(value, settings.threads);
+    else if (key == "renderer")    settings.renderer = value;
+    else if (key == "fps")         valid = parse_int(value, settings.fps);
+    else if (key == "vsync")       valid = parse_bool(value, settings.vsync);
+    else if (key == "sim-rate")    valid = parse_int(value, settings.sim_rate);
+    else if (key == "profiler-hud") valid = parse_bool(value, settings.profiler_hud);
+    else if (key == "profiler-csv") settings.profiler_csv = value;
+    else if (key == "damage-overlay") valid = parse_bool(value, settings.damage_overlay);
+    else if (key == "count-allocations") valid = parse_bool(value, settings.count_allocations);
+    else if (key == "shm")         settings.shm = value;
+    else if (key == "offline")     settings.offline_input = value;
+    else if (key == "output")      settings.offline_output = value;
+    else if (key == "export")      settings.export_input = value;
+    else if (key == "video-format") settings.video_format = value;
+    else {
+        std::cout << RED << "[ERROR]" << CLEAR << " Unknown setting '" << key << "'." << std::endl;
+        return false;
+    }
+
+    if (!valid) {
+        std::cout << RED << "[ERROR]" << CLEAR << " Invalid value '" << value << "' for setting '" << key << "'." << std::endl;
+    }
+
+    return valid;
+}
+
+
+static std::string trim(const std::string& text) {
+    size_t start = text.find_first_not_of(" \t\r");
+    size_t end   = text.find_last_not_of(" \t\r");
+    return start == std::string::npos ? "" : text.substr(start, end - start + 1);
+}
+
+
+static bool load_settings_file(const std::string& path, bool required) {
+    std::ifstream file(path);
+
+    if (!file) {
+        if (required) {
+            std::cout << RED << "[ERROR]" << CLEAR << " Unable to open settings file " << path << "." << std::endl;
+        }
+        return !required;
+    }
+
+    std::string line;
+    int line_number = 0;
+
+    while (std::getline(file, line)) {
+        line_number++;
+        line = trim(line.substr(0, line.find('#')));
+        if (line.empty()) continue;
+
+        size_t separator = line.find('=');
+        if (separator == std::string::npos) {
+            std::cout << RED << "[ERROR]" << CLEAR << " " << path << ":" << line_number << ": expected 'key = value'." << std::endl;
+            return false;
+        }
+
+        if (!apply_setting(trim(line.substr(0, separator)), trim(line.substr(separator + 1)))) {
+            return false;
+        }
+    }
+
+    std::cout << GREEN << "[INFO]" << CLEAR << " Loaded settings from " << path << "." << std::endl;
+
+    return true;
+}
+
+
+bool parse_settings(int argc, char* argv[]) {
+    std::string settings_file = SETTINGS_FILE;
+    bool settings_file_required = false;
+
+    // The settings file is applied first so the command line can override it
+    for (int i = 1; i < argc - 1; i++) {
+        if (std::string(argv[i]) == "--config") {
+            settings_file = argv[i + 1];
+            settings_file_required = true;
+        }
+    }
+
+    if (!load_settings_file(settings_file, settings_file_required)) {
+        return false;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+
+        if (argument == "--help") {
+            print_usage(argv[0]);
+            return false;
+        }
+
+        if (argument.rfind("--", 0) != 0 || i + 1 >= argc) {
+            std::cout << RED << "[ERROR]" << CLEAR << " Invalid argument '" << argument << "'." << std::endl;
+            print_usage(argv[0]);
+            return false;
+        }
+
+        std::string value = argv[++i];
+        if (argument == "--config") continue;
+
+        if (!apply_setting(argument.substr(2), value)) {
+            return false;
+        }
+    }
+
+    if (settings.hop_size > settings.fft_size) {
+        std::cout << RED << "[ERROR]" << CLEAR << " The hop size can't be larger than the FFT size." << std::endl;
+        return false;
+    }
+
+    return true;
+}
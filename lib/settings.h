@@ -0,0 +1,48 @@
+#ifndef _SETTINGS_H_
+#define _SETTINGS_H_
+
+
+#include "main.h"
+
+
+#define SETTINGS_FILE "audio_visualizer.conf"
+
+
+// Runtime configuration. Defaults can be overridden by the settings file and then by the
+// command line, e.g. "--bars 64" on the command line or "bars = 64" in the settings file.
+struct Settings {
+    unsigned int channels    = 2;
+    unsigned int sample_rate = 44100;
+    int          fft_size    = 2048;    // Analysis window length in samples
+    int          hop_size    = 512;     // Samples between consecutive spectra
+    int          band_count  = 20;
+    std::string  window      = "hann";  // hann, blackman-harris or rectangular
+    std::string  analysis    = "linear";  // linear or multires (finer bass bands)
+    std::vector<std::string> inputs = {INPUT_DEVICE};  // Capture devices, one spectrum panel each
+    int          analysis_threads = 0;  // Analysis workers shared by the inputs, 0 is one per input
+    int          particle_count = 1000;  // Number of background particles
+    int          threads     = 0;       // Update threads, 0 uses every core and 1 is deterministic
+    std::string  renderer    = "sdl";   // sdl for a window, software for a headless framebuffer
+    int          fps         = 60;      // Display frame rate, also the frame rate of --export
+    bool         vsync       = false;   // Present on the display refresh instead of pacing to fps
+    int          sim_rate    = 240;     // Fixed simulation steps per second, rendering interpolates
+    bool         profiler_hud = false;  // Show the per-stage frame timings on screen
+    std::string  profiler_csv;          // Write the per-stage timings of every frame to this CSV file
+    bool         damage_overlay = false;  // Outline the regions redrawn every frame
+    bool         count_allocations = false;  // Report frames that allocate after the warm-up
+    std::string  shm;                   // Publish the spectra in this POSIX shared memory segment, e.g. /audio_visualizer
+
+    std::string  offline_input;          // Analyze this WAV/raw file instead of capturing audio
+    std::string  offline_output;         // Band intensities of the offline analysis (CSV or .bin) or the exported video
+
+    std::string  export_input;           // Render the visualization of this WAV/raw file as raw video
+    std::string  video_format = "yuv420p";  // rgb24 or yuv420p
+};
+
+
+extern Settings settings;
+
+bool parse_settings(int argc, char* argv[]);
+
+
+#endif
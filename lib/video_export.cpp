@@ -0,0 +1,281 @@
+#include "video_export.h"
+#include "settings.h"
+#include "job_system.h"
+#include "gui/simple_graphics.h"
+#include "gui/pixel_kernels.h"
+#include "audio/audio_capture.h"
+#include "audio/audio_visuals.h"
+#include "audio/pcm_file.h"
+#include <condition_variable>
+
+
+// Frames in flight between the render thread and the writer thread
+#define EXPORT_QUEUE_FRAMES 4
+
+
+// A frame on its way to the writer. Only the rows that changed since the previous frame are
+// copied into it, the other rows hold whatever an older frame left there.
+struct ExportFrame {
+    std::vector<uint32_t> pixels;
+    std::vector<uint8_t>  changed_rows;  // 1 for every row that differs from the previous frame
+};
+
+
+// A fixed set of frame buffers handed from the render thread to the writer thread and back in
+// order, so exporting allocates nothing per frame
+class FrameQueue {
+
+public:
+    FrameQueue(int width, int height) : slots(EXPORT_QUEUE_FRAMES) {
+        for (ExportFrame& slot : slots) {
+            slot.pixels.resize((size_t)width * height);
+            slot.changed_rows.resize(height);
+        }
+    }
+
+    // Render side. Blocks while every slot is full, returns nullptr if the writer gave up.
+    ExportFrame* acquire_free() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return filled < slots.size() || aborted; });
+        return aborted ? nullptr : &slots[render_index % slots.size()];
+    }
+
+    void push_filled() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            render_index++;
+            filled++;
+        }
+        changed.notify_all();
+    }
+
+    void finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+        }
+        changed.notify_all();
+    }
+
+    // Writer side. Blocks until a frame is ready, returns nullptr once all frames are written.
+    const ExportFrame* acquire_filled() {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return filled > 0 || finished; });
+        return filled > 0 ? &slots[write_index % slots.size()] : nullptr;
+    }
+
+    void release() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            write_index++;
+            filled--;
+        }
+        changed.notify_all();
+    }
+
+    void abort() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            aborted = true;
+        }
+        changed.notify_all();
+    }
+
+
+private:
+    std::vector<ExportFrame> slots;
+    size_t render_index = 0;
+    size_t write_index  = 0;
+    size_t filled       = 0;
+    bool   finished     = false;
+    bool   aborted      = false;
+
+    std::mutex              mutex;
+    std::condition_variable changed;
+
+};
+
+
+// Marks the rows the last presented frame changed and copies them out of the framebuffer. The
+// first frame is copied completely. Rows are marked in groups of row_step, the rows the writer
+// converts together.
+static void copy_changed_rows(ExportFrame& frame, bool first_frame, int row_step) {
+    std::fill(frame.changed_rows.begin(), frame.changed_rows.end(), first_frame ? 1 : 0);
+
+    for (const DamageRect& rect : simple_graphics::frame_damage()) {
+        int top    = std::max(0, rect.position.y) / row_step * row_step;
+        int bottom = std::min(HEIGHT, (rect.position.y + rect.size.height + row_step - 1) / row_step * row_step);
+        std::fill(frame.changed_rows.begin() + top, frame.changed_rows.begin() + std::max(top, bottom), 1);
+    }
+
+    const uint32_t* framebuffer = simple_graphics::framebuffer();
+    for (int row = 0; row < HEIGHT; row++) {
+        if (!frame.changed_rows[row]) continue;
+
+        const uint32_t* source = framebuffer + (size_t)row * WIDTH;
+        std::copy(source, source + WIDTH, frame.pixels.begin() + (size_t)row * WIDTH);
+    }
+}
+
+
+// Converts the frames to the output format and writes them while the next ones are rendered.
+// The encoded frame is kept, so only the rows that changed are converted again. In yuv420p a
+// chroma row covers two pixel rows, so the rows are marked and converted in pairs.
+static void writer_thread(FrameQueue& queue, FILE* output, bool yuv, bool& write_failed) {
+    const size_t pixels = (size_t)WIDTH * HEIGHT;
+    const int    step   = yuv ? 2 : 1;
+    std::vector<uint8_t> encoded(yuv ? pixels * 3 / 2 : pixels * 3);
+
+    while (const ExportFrame* frame = queue.acquire_filled()) {
+        for (int row = 0; row < HEIGHT; row += step) {
+            if (!frame->changed_rows[row]) continue;
+
+            // The run of changed rows starting here
+            int end = row + step;
+            while (end < HEIGHT && frame->changed_rows[end]) end += step;
+
+            const uint32_t* source = frame->pixels.data() + (size_t)row * WIDTH;
+            if (yuv) {
+                uint8_t* y_plane = encoded.data() + (size_t)row * WIDTH;
+                uint8_t* u_plane = encoded.data() + pixels + (size_t)(row / 2) * (WIDTH / 2);
+                uint8_t* v_plane = u_plane + pixels / 4;
+                rgba_to_yuv420p(source, WIDTH, end - row, y_plane, u_plane, v_plane);
+            } else {
+                rgba_to_rgb24(source, (end - row) * WIDTH, encoded.data() + (size_t)row * WIDTH * 3);
+            }
+
+            row = end - step;
+        }
+
+        queue.release();
+
+        if (fwrite(encoded.data(), 1, encoded.size(), output) != encoded.size()) {
+            std::cout << RED << "[VE ERROR]" << CLEAR << " Failed to write the video stream: " << strerror(errno) << std::endl;
+            write_failed = true;
+            queue.abort();
+            return;
+        }
+    }
+}
+
+
+bool run_video_export(const std::string& input_path, const std::string& output_path) {
+    std::cout << GREEN << "[VE INFO]" << CLEAR << " Exporting the visualization of " << input_path << "..." << std::endl;
+
+    bool yuv = settings.video_format == "yuv420p";
+    if (!yuv && settings.video_format != "rgb24") {
+        std::cout << RED << "[VE ERROR]" << CLEAR << " Unknown video format '" << settings.video_format << "'." << std::endl;
+        return false;
+    }
+
+    PCMFile file;
+    if (!file.open(input_path, settings.channels, settings.sample_rate)) {
+        return false;
+    }
+
+    AnalysisConfig config;
+    if (!make_analysis_config(config)) {
+        return false;
+    }
+
+    config.channels    = file.channels();
+    config.sample_rate = file.sample_rate();
+
+    std::unique_ptr<AnalysisPipeline> pipeline = create_analysis_pipeline(config);
+    if (!pipeline->prepare()) {
+        return false;
+    }
+
+    // No window, the frames only exist in the software renderer's framebuffer
+    if (!simple_graphics::init("software") || !simple_graphics::create_display("Audio Visualizer", WIDTH, HEIGHT) ||
+        !job_system::init(settings.threads) || !audio_visuals::init()) {
+        return false;
+    }
+
+    simple_graphics::set_damage_overlay(settings.damage_overlay);
+
+    bool to_stdout = output_path.empty() || output_path == "-";
+    FILE* output = to_stdout ? stdout : fopen(output_path.c_str(), "wb");
+    if (output == nullptr) {
+        std::cout << RED << "[VE ERROR]" << CLEAR << " Unable to open " << output_path << " for writing." << std::endl;
+        simple_graphics::close_display();
+        return false;
+    }
+
+    // A closed pipe shows up as a failed write instead of killing the process
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(output, nullptr, _IOFBF, 1 << 20);
+
+    const double fps      = settings.fps;
+    const double frame_ms = 1000.0 / fps;
+
+    // The same fixed steps as the live loop, so the export animates exactly like it. Frames are
+    // never late here, so no time is dropped.
+    const double simulation_step = 1000.0 / settings.sim_rate;
+    double unsimulated_time = 0.0;
+    const size_t hop_count   = file.frame_count() / config.hop_size;
+    const size_t video_frames = (size_t)(file.frame_count() * fps / config.sample_rate);
+
+    std::vector<double> band_intensities(config.band_count, 0.0);
+
+    FrameQueue queue(WIDTH, HEIGHT);
+    bool write_failed = false;
+    std::thread writer(writer_thread, std::ref(queue), output, yuv, std::ref(write_failed));
+
+    auto start_time = std::chrono::steady_clock::now();
+    size_t hop = 0, frame = 0;
+
+    for (; frame < video_frames && !PROCESS_INTERRUPTED; frame++) {
+        // Every hop whose analysis window ends before the end of this frame
+        size_t audio_end = (size_t)((frame + 1) * (double)config.sample_rate / fps);
+        while (hop < hop_count && (hop + 1) * config.hop_size <= audio_end) {
+            pipeline->process_hop(file.frames() + hop * config.hop_size * config.channels, band_intensities.data());
+            hop++;
+        }
+
+        audio_visuals::set_band_intensities(band_intensities);
+
+        unsimulated_time += frame_ms;
+        while (unsimulated_time >= simulation_step) {
+            audio_visuals::update(simulation_step);
+            unsimulated_time -= simulation_step;
+        }
+
+        audio_visuals::render(unsimulated_time / simulation_step);
+        simple_graphics::update_display();
+
+        ExportFrame* slot = queue.acquire_free();
+        if (slot == nullptr) break;
+
+        copy_changed_rows(*slot, frame == 0, yuv ? 2 : 1);
+        queue.push_filled();
+    }
+
+    queue.finish();
+    writer.join();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    double video_seconds = frame / fps;
+
+    std::cout << GREEN << "[VE INFO]" << CLEAR << " Rendered " << frame << " frames (" << video_seconds << " s of video) in "
+              << elapsed.count() << " s: " << frame / elapsed.count() << " frames/s, "
+              << video_seconds / elapsed.count() << "x real time." << std::endl;
+
+    bool flushed = fflush(output) == 0;
+    if (!to_stdout) flushed = fclose(output) == 0 && flushed;
+
+    job_system::print_stats();
+    job_system::shutdown();
+    simple_graphics::close_display();
+
+    if (write_failed || !flushed) {
+        if (!write_failed) std::cout << RED << "[VE ERROR]" << CLEAR << " Failed to write " << output_path << "." << std::endl;
+        return false;
+    }
+
+    std::cout << GREEN << "[VE INFO]" << CLEAR << " Encode with: ffmpeg -f rawvideo -pix_fmt " << settings.video_format
+              << " -s " << WIDTH << "x" << HEIGHT << " -r " << settings.fps << " -i <video> -i " << input_path
+              << " -shortest output.mp4" << std::endl;
+
+    return true;
+}
@@ -0,0 +1,16 @@
+#ifndef _VIDEO_EXPORT_H_
+#define _VIDEO_EXPORT_H_
+
+
+#include "main.h"
+
+
+// Renders the visualization of a WAV or raw PCM file faster than real time. The simulation
+// advances by exactly one frame duration per frame, in the fixed steps of the live loop, and
+// every frame sees the audio up to its own timestamp, so the video stays in sync with the
+// track. Frames are drawn with the software renderer and written as headerless rawvideo (rgb24
+// or yuv420p) to output_path, or to stdout if it is "-". Returns false on error.
+bool run_video_export(const std::string& input_path, const std::string& output_path);
+
+
+#endif
@@ -1,11 +1,22 @@
 #include "lib/main.h"
 #include "lib/gui/simple_graphics.h"
+#include "lib/gui/frame_pacer.h"
 #include "lib/audio/audio_capture.h"
 #include "lib/audio/audio_visuals.h"
+#include "lib/audio/spectrum_publisher.h"
+#include "lib/settings.h"
+#include "lib/job_system.h"
+#include "lib/profiler.h"
+#include "lib/allocation_counter.h"
+#include "lib/audio/offline_analysis.h"
+#include "lib/video_export.h"
 
 
 volatile bool PROCESS_INTERRUPTED = false;
 
+// Most simulation steps run for one frame
+#define MAX_SIMULATION_STEPS 8
+
 
 void handle_sigint(int signal) {
     (void)signal;
@@ -14,9 +25,20 @@ void handle_sigint(int signal) {
 }
 
 
-int main() {
+int main(int argc, char* argv[]) {
     signal(SIGINT, handle_sigint);
 
+    if (!parse_settings(argc, argv)) {
+        return 1;
+    }
+
+
+    // Raw video on stdout, keep the log messages out of it
+    bool video_to_stdout = !settings.export_input.empty() && (settings.offline_output.empty() || settings.offline_output == "-");
+    if (video_to_stdout) {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
 
     double elapsed_time = 0.0;
 
@@ -30,102 +52,88 @@ int main() {
     "╚═╝  ╚═╝ ╚═════╝ ╚═════╝ ╚═╝ ╚═════╝       ╚═══╝  ╚═╝╚══════╝ ╚═════╝ ╚═╝  ╚═╝╚══════╝╚═╝╚══════╝╚══════╝╚═╝  ╚═╝ v1.1"
     "\n" << CLEAR << std::endl;
 
+    // Headless mode, no audio devices and no window needed
+    if (!settings.offline_input.empty()) {
+        return run_offline_analysis(settings.offline_input, settings.offline_output) ? 0 : 1;
+    }
+
+    if (!settings.export_input.empty()) {
+        return run_video_export(settings.export_input, settings.offline_output) ? 0 : 1;
+    }
+
     std::cout << GREEN << "[INFO]" << CLEAR << " Setup started. Initializing..." << std::endl;
 
 
-    if (!simple_graphics::init()) {
+    if (!simple_graphics::init(settings.renderer.c_str())) {
         PROCESS_INTERRUPTED = true;
     }
 
-    if (!simple_graphics::create_display("Audio Visualizer", WIDTH, HEIGHT, FLAGS)) {
+    if (!simple_graphics::create_display("Audio Visualizer", WIDTH, HEIGHT, FLAGS, settings.vsync)) {
         PROCESS_INTERRUPTED = true;
     }
 
-    if (!audio_visuals::init()) {
+    simple_graphics::set_damage_overlay(settings.damage_overlay);
+
+    if (!job_system::init(settings.threads)) {
         PROCESS_INTERRUPTED = true;
     }
 
+    if (!profiler::init(settings.profiler_hud, settings.profiler_csv)) {
+        PROCESS_INTERRUPTED = true;
+    }
+
+    if (!audio_visuals::init(settings.inputs)) {
+        PROCESS_INTERRUPTED = true;
+    }
 
-    std::thread audio_thread(audio_capture_and_playback_thread);
+    if (!init_analysis()) {
+        PROCESS_INTERRUPTED = true;
+    }
 
-    // Wait until the thread is initialized and running
+    if (!settings.shm.empty() &&
+        !spectrum_publisher::init(settings.shm, settings.inputs, settings.band_count, settings.sample_rate, settings.hop_size)) {
+        PROCESS_INTERRUPTED = true;
+    }
+
+
+    // One capture thread per input, the analysis workers are shared by all of them
+    std::vector<std::thread> capture_threads;
+    for (size_t i = 0; i < capture_sources.size(); i++) {
+        capture_threads.emplace_back(capture_thread, i);
+    }
+
+    std::vector<std::thread> analysis_workers;
+    for (int i = 0; i < analysis_worker_count(settings.analysis_threads); i++) {
+        analysis_workers.emplace_back(analysis_thread);
+    }
+
+    // Wait until the threads are initialized and running
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
 
 
     std::cout << GREEN << "[INFO]" << CLEAR << " Setup complete. Program running..." << std::endl;
 
 
-    while (!PROCESS_INTERRUPTED) {
+    // The simulation advances in fixed steps, so the animation speed doesn't depend on the
+    // frame rate or on how long a frame took. Every frame is drawn between the last two steps.
+    FramePacer frame_pacer(settings.fps, settings.vsync);
+    const double simulation_step = 1000.0 / settings.sim_rate;
+    double unsimulated_time = 0.0;
 
-        visualize_audio();  // Do all the necessary calculations
+    allocation_counter::init(settings.count_allocations);
 
-        // Clear the display and draw the particles first
-        simple_graphics::fill_display(RGBColor{0, 0, 0});
+    while (!PROCESS_INTERRUPTED) {
 
-        for (int i = 0; i < particles.size(); i++) {
-            particles[i].update(elapsed_time);
-            particles[i].draw();
-        }
+        visualize_audio();  // Pick up the newest spectrum of every input
 
-        // Draw the title and the info texts
-        simple_graphics::draw_text(
-            "Audio Visualizer v1.1", Position2d{10, 10},
-            simple_graphics::font24, RGBColor{255, 255, 255}, true
-        );
-
-        simple_graphics::draw_text(
-            "20 Hz",
-            Position2d{
-                WIDTH/2  - VISUALIZER_WIDTH/2 - 70,
-                HEIGHT/2 - 11
-            }, simple_graphics::font16, RGBColor{255, 255, 255}, true
-        );
- 
-        simple_graphics::draw_text(
-            "20 kHz",
-            Position2d{
-                WIDTH/2  + VISUALIZER_WIDTH/2 + 20,
-                HEIGHT/2 - 11
-            }, simple_graphics::font16, {255, 255, 255}, true
-        );
- 
-        simple_graphics::draw_text(
-            (std::string("Max intensity: ") + std::to_string(maximum_intensity)).c_str(),
-            Position2d{
-                WIDTH/2  - VISUALIZER_WIDTH/2  - 10,
-                HEIGHT/2 + VISUALIZER_HEIGHT/2 + 20
-            }, simple_graphics::font16, RGBColor{255, 255, 255}, true
-        );
-
-        // Draw the boxes around the audio visualizer
-        simple_graphics::draw_rect(
-            Position2d{
-                WIDTH/2  - VISUALIZER_WIDTH/2  - 10,
-                HEIGHT/2 - VISUALIZER_HEIGHT/2 - 10
-            },
-            Size2d{
-                VISUALIZER_WIDTH  + 20,
-                VISUALIZER_HEIGHT + 20
-            }, RGBColor{20, 20, 20}, true
-        );
-        
-        simple_graphics::draw_rect(
-            Position2d{
-                WIDTH/2  - VISUALIZER_WIDTH/2  - 10,
-                HEIGHT/2 - VISUALIZER_HEIGHT/2 - 10
-            },
-            Size2d{
-                VISUALIZER_WIDTH  + 20,
-                VISUALIZER_HEIGHT + 20
-            }, RGBColor{150, 150, 150}, false
-        );
-
-        // Update and draw the audio visualizer
-        for (int i = 0; i < frequency_intensity_bars.size(); i++) {
-            frequency_intensity_bars[i].update(elapsed_time);
-            frequency_intensity_bars[i].draw();
+        // After a long stall the lost time is dropped instead of simulated all at once
+        unsimulated_time = std::min(unsimulated_time + elapsed_time, MAX_SIMULATION_STEPS * simulation_step);
+        while (unsimulated_time >= simulation_step) {
+            audio_visuals::update(simulation_step);
+            unsimulated_time -= simulation_step;
         }
 
+        audio_visuals::render(unsimulated_time / simulation_step);  // Draw everything on the display
 
         // Handle keyboard inputs
 
@@ -143,8 +151,20 @@ int main() {
         }
 
 
-        simple_graphics::update_display();
-        elapsed_time = simple_graphics::limit_fps(60);
+        profiler::draw_hud();
+
+        {
+            PROFILE_SCOPE(Present);
+            simple_graphics::update_display();
+        }
+
+        {
+            PROFILE_SCOPE(Wait);
+            elapsed_time = frame_pacer.wait();
+        }
+
+        profiler::end_frame();
+        allocation_counter::end_frame();
     }
 
 
@@ -153,8 +173,25 @@ int main() {
     // Clean up
     simple_graphics::close_display();
 
-    if (audio_thread.joinable())
-        audio_thread.join();
+    for (std::thread& thread : capture_threads) {
+        if (thread.joinable())
+            thread.join();
+    }
+
+    for (std::thread& thread : analysis_workers) {
+        if (thread.joinable())
+            thread.join();
+    }
+
+    spectrum_publisher::shutdown();
+    print_analysis_stats();
+
+    frame_pacer.print_stats();
+    profiler::print_stats();
+    profiler::shutdown();
+    allocation_counter::print_stats();
+    job_system::print_stats();
+    job_system::shutdown();
 
     std::cout << GREEN << "[INFO]" << CLEAR << " Application shutdown complete.\n" << std::endl;
 